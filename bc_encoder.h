@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// Block compression for the texture cook tool. Straightforward range-fit
+// encoders: endpoints from the block's bounding box (inset slightly), then
+// the nearest palette entry per pixel. Quality is a little below dedicated
+// encoders but good enough for the scene's photographic textures and fast
+// enough to cook at build time.
+namespace bc_encoder
+{
+    inline uint16_t Pack565(int r, int g, int b)
+    {
+        return (uint16_t)(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+    }
+
+    inline void Unpack565(uint16_t c, int& r, int& g, int& b)
+    {
+        int r5 = (c >> 11) & 31, g6 = (c >> 5) & 63, b5 = c & 31;
+        r = (r5 << 3) | (r5 >> 2);
+        g = (g6 << 2) | (g6 >> 4);
+        b = (b5 << 3) | (b5 >> 2);
+    }
+
+    // 16 RGBA pixels (row major) -> 8 byte BC1 block, always four-colour mode
+    inline void EncodeColorBlock(const uint8_t* rgba, uint8_t* out)
+    {
+        int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                lo[c] = std::min(lo[c], (int)rgba[i * 4 + c]);
+                hi[c] = std::max(hi[c], (int)rgba[i * 4 + c]);
+            }
+        }
+        // pull the endpoints in by 1/16 of the range so the palette covers the middle better
+        for (int c = 0; c < 3; ++c)
+        {
+            int inset = (hi[c] - lo[c]) / 16;
+            lo[c] += inset;
+            hi[c] -= inset;
+        }
+
+        uint16_t c0 = Pack565(hi[0], hi[1], hi[2]);
+        uint16_t c1 = Pack565(lo[0], lo[1], lo[2]);
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        uint32_t indices = 0;
+        if (c0 != c1)
+        {
+            int palette[4][3];
+            Unpack565(c0, palette[0][0], palette[0][1], palette[0][2]);
+            Unpack565(c1, palette[1][0], palette[1][1], palette[1][2]);
+            for (int c = 0; c < 3; ++c)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+
+            for (int i = 0; i < 16; ++i)
+            {
+                int best = 0, bestError = 1 << 30;
+                for (int p = 0; p < 4; ++p)
+                {
+                    int dr = rgba[i * 4] - palette[p][0];
+                    int dg = rgba[i * 4 + 1] - palette[p][1];
+                    int db = rgba[i * 4 + 2] - palette[p][2];
+                    int error = dr * dr + dg * dg + db * db;
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        best = p;
+                    }
+                }
+                indices |= (uint32_t)best << (i * 2);
+            }
+        }
+        // c0 == c1: every index 0 is exact
+
+        out[0] = (uint8_t)(c0 & 0xFF);
+        out[1] = (uint8_t)(c0 >> 8);
+        out[2] = (uint8_t)(c1 & 0xFF);
+        out[3] = (uint8_t)(c1 >> 8);
+        for (int i = 0; i < 4; ++i)
+            out[4 + i] = (uint8_t)(indices >> (i * 8));
+    }
+
+    // 16 RGBA pixels -> 8 byte BC3 alpha block, eight-value mode
+    inline void EncodeAlphaBlock(const uint8_t* rgba, uint8_t* out)
+    {
+        int lo = 255, hi = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            lo = std::min(lo, (int)rgba[i * 4 + 3]);
+            hi = std::max(hi, (int)rgba[i * 4 + 3]);
+        }
+
+        out[0] = (uint8_t)hi;
+        out[1] = (uint8_t)lo;
+
+        uint64_t indices = 0;
+        if (hi != lo)
+        {
+            // palette: a0, a1, then six steps from a0 towards a1
+            int palette[8] = { hi, lo };
+            for (int p = 1; p <= 6; ++p)
+                palette[p + 1] = ((7 - p) * hi + p * lo) / 7;
+
+            for (int i = 0; i < 16; ++i)
+            {
+                int best = 0, bestError = 1 << 30;
+                for (int p = 0; p < 8; ++p)
+                {
+                    int error = std::abs(rgba[i * 4 + 3] - palette[p]);
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        best = p;
+                    }
+                }
+                indices |= (uint64_t)best << (i * 3);
+            }
+        }
+        for (int i = 0; i < 6; ++i)
+            out[2 + i] = (uint8_t)(indices >> (i * 8));
+    }
+
+    // Encodes a whole RGBA8 image. Blocks hanging over the right / top edge
+    // repeat the last row / column.
+    inline std::vector<uint8_t> EncodeImage(const uint8_t* rgba, int width, int height, bool withAlpha)
+    {
+        const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        const int blockBytes = withAlpha ? 16 : 8;
+        std::vector<uint8_t> out((size_t)blocksX * blocksY * blockBytes);
+
+        uint8_t block[16 * 4];
+        for (int by = 0; by < blocksY; ++by)
+        {
+            for (int bx = 0; bx < blocksX; ++bx)
+            {
+                for (int y = 0; y < 4; ++y)
+                {
+                    int sy = std::min(by * 4 + y, height - 1);
+                    for (int x = 0; x < 4; ++x)
+                    {
+                        int sx = std::min(bx * 4 + x, width - 1);
+                        const uint8_t* pixel = rgba + ((size_t)sy * width + sx) * 4;
+                        std::copy(pixel, pixel + 4, block + (y * 4 + x) * 4);
+                    }
+                }
+
+                uint8_t* target = &out[((size_t)by * blocksX + bx) * blockBytes];
+                if (withAlpha)
+                {
+                    EncodeAlphaBlock(block, target);
+                    EncodeColorBlock(block, target + 8);
+                }
+                else
+                    EncodeColorBlock(block, target);
+            }
+        }
+        return out;
+    }
+}
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "profiler.h"
+
+// One point on a scripted camera path. Angles follow the camera class:
+// degrees, yaw -90 looks down -Z, positive pitch looks up.
+struct CameraKey
+{
+    float time;         // seconds from the start of the path
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+};
+
+// Camera keyframes played back with linear interpolation. Yaw is not
+// wrapped, so a full orbit is written as a continuous run of angles.
+class CameraPath
+{
+public:
+    explicit CameraPath(const std::string& name = "") : mName(name) {}
+
+    const std::string& Name() const { return mName; }
+    float Duration() const { return mKeys.empty() ? 0.0f : mKeys.back().time; }
+
+    void AddKey(float time, const glm::vec3& position, float yaw, float pitch)
+    {
+        CameraKey key = { time, position, yaw, pitch };
+        mKeys.push_back(key);
+    }
+
+    // Key placed at position and turned to face target
+    void AddLookAt(float time, const glm::vec3& position, const glm::vec3& target)
+    {
+        glm::vec3 direction = glm::normalize(target - position);
+        float yaw = glm::degrees(atan2f(direction.z, direction.x));
+        float pitch = glm::degrees(asinf(direction.y));
+
+        // keep yaw continuous with the previous key so it never spins the long way round
+        if (!mKeys.empty())
+        {
+            while (yaw - mKeys.back().yaw > 180.0f) yaw -= 360.0f;
+            while (yaw - mKeys.back().yaw < -180.0f) yaw += 360.0f;
+        }
+        AddKey(time, position, yaw, pitch);
+    }
+
+    // Camera state at time t, looping once the path runs out
+    CameraKey Sample(float t) const
+    {
+        if (mKeys.size() < 2)
+            return mKeys.empty() ? CameraKey() : mKeys.front();
+
+        t = fmodf(t, Duration());
+        size_t next = 1;
+        while (next < mKeys.size() - 1 && mKeys[next].time < t)
+            ++next;
+
+        const CameraKey& a = mKeys[next - 1];
+        const CameraKey& b = mKeys[next];
+        float span = b.time - a.time;
+        float f = span > 0.0f ? std::min(std::max((t - a.time) / span, 0.0f), 1.0f) : 1.0f;
+
+        CameraKey key;
+        key.time = t;
+        key.position = glm::mix(a.position, b.position, f);
+        key.yaw = a.yaw + (b.yaw - a.yaw) * f;
+        key.pitch = a.pitch + (b.pitch - a.pitch) * f;
+        return key;
+    }
+
+private:
+    std::string mName;
+    std::vector<CameraKey> mKeys;
+};
+
+// Frame time distribution in milliseconds
+struct FrameTimeStats
+{
+    float min, avg, p50, p95, p99, max;
+    size_t frames;
+
+    static FrameTimeStats From(std::vector<float> samples)
+    {
+        FrameTimeStats stats = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, samples.size() };
+        if (samples.empty())
+            return stats;
+
+        std::sort(samples.begin(), samples.end());
+        double total = 0.0;
+        for (size_t i = 0; i < samples.size(); ++i)
+            total += samples[i];
+
+        stats.min = samples.front();
+        stats.max = samples.back();
+        stats.avg = (float)(total / samples.size());
+        stats.p50 = NearestRankPercentile(samples, 0.50);
+        stats.p95 = NearestRankPercentile(samples, 0.95);
+        stats.p99 = NearestRankPercentile(samples, 0.99);
+        return stats;
+    }
+};
+
+// Results of one benchmark path
+struct BenchmarkResult
+{
+    std::string path;
+    FrameTimeStats cpu;     // wall time of URender (submission, plus swap when windowed)
+    float gpuAvg, gpuP95, gpuP99;     // from the profiler's GPU timestamps
+    int draws;
+    int instances;
+    float culledAvg;        // objects rejected by frustum culling, per measured frame
+    int lights;             // in the clustered light list
+    float lightAssignAvg;   // CPU ms of the light assignment pass
+    int shadowRebuilds;     // shadow map redraws during the measured frames
+    double fragmentsAvg;    // shading pass fragment invocations per frame (not the depth pre-pass), 0 without pipeline statistics
+};
+
+// Allowed slowdown against the baseline before a metric counts as a regression
+struct RegressionThresholds
+{
+    float avgPercent;
+    float p99Percent;
+};
+
+// Collects benchmark results, writes them as JSON and compares them with a
+// stored baseline written by an earlier run
+class BenchmarkReport
+{
+public:
+    BenchmarkReport(const std::string& renderer, float timestep, int frames, int warmup)
+        : mRenderer(renderer), mTimestep(timestep), mFrames(frames), mWarmup(warmup)
+    {
+    }
+
+    void Add(const BenchmarkResult& result) { mResults.push_back(result); }
+
+    bool WriteJson(const std::string& filename) const
+    {
+        FILE* file = fopen(filename.c_str(), "w");
+        if (!file)
+        {
+            std::cout << "WARNING: Could not write benchmark results to " << filename << std::endl;
+            return false;
+        }
+
+        fprintf(file, "{\n  \"renderer\": \"%s\",\n  \"timestep\": %.6f,\n  \"frames\": %d,\n  \"warmup\": %d,\n  \"paths\": [",
+            Escape(mRenderer).c_str(), mTimestep, mFrames, mWarmup);
+        for (size_t i = 0; i < mResults.size(); ++i)
+        {
+            const BenchmarkResult& r = mResults[i];
+            fprintf(file, "%s\n    { \"name\": \"%s\", \"instances\": %d, \"draws\": %d, \"culled_avg\": %.2f,\n", i ? "," : "",
+                r.path.c_str(), r.instances, r.draws, r.culledAvg);
+            fprintf(file, "      \"lights\": %d, \"light_assign_ms\": %.4f, \"shadow_rebuilds\": %d, \"shading_fragment_invocations\": %.0f,\n",
+                r.lights, r.lightAssignAvg, r.shadowRebuilds, r.fragmentsAvg);
+            fprintf(file, "      \"cpu_ms\": { \"min\": %.4f, \"avg\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+                r.cpu.min, r.cpu.avg, r.cpu.p50, r.cpu.p95, r.cpu.p99, r.cpu.max);
+            fprintf(file, "      \"gpu_ms\": { \"avg\": %.4f, \"p95\": %.4f, \"p99\": %.4f } }", r.gpuAvg, r.gpuP95, r.gpuP99);
+        }
+        fprintf(file, "\n  ]\n}\n");
+        fclose(file);
+
+        std::cout << "INFO: Benchmark results written to " << filename << std::endl;
+        return true;
+    }
+
+    // Prints every metric against the baseline. Returns false when any
+    // avg / p99 is slower than the baseline by more than its threshold.
+    // Paths missing from the baseline are reported and skipped.
+    bool CompareToBaseline(const std::string& filename, const RegressionThresholds& thresholds) const
+    {
+        std::ifstream in(filename.c_str());
+        if (!in)
+        {
+            std::cout << "WARNING: Could not read benchmark baseline " << filename << std::endl;
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        const std::string baseline = buffer.str();
+
+        bool passed = true;
+        for (size_t i = 0; i < mResults.size(); ++i)
+        {
+            const BenchmarkResult& r = mResults[i];
+            std::string entry;
+            if (!FindPath(baseline, r.path, entry))
+            {
+                std::cout << "INFO: Path '" << r.path << "' has no baseline entry" << std::endl;
+                continue;
+            }
+
+            passed &= Check(r.path, "cpu avg", entry, "cpu_ms", "avg", r.cpu.avg, thresholds.avgPercent);
+            passed &= Check(r.path, "cpu p99", entry, "cpu_ms", "p99", r.cpu.p99, thresholds.p99Percent);
+            passed &= Check(r.path, "gpu avg", entry, "gpu_ms", "avg", r.gpuAvg, thresholds.avgPercent);
+            passed &= Check(r.path, "gpu p99", entry, "gpu_ms", "p99", r.gpuP99, thresholds.p99Percent);
+        }
+
+        std::cout << (passed ? "INFO: Benchmark within baseline thresholds" : "WARNING: Benchmark regressed against baseline") << std::endl;
+        return passed;
+    }
+
+private:
+    static std::string Escape(const std::string& text)
+    {
+        std::string escaped;
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            if (text[i] == '"' || text[i] == '\\')
+                escaped += '\\';
+            escaped += text[i];
+        }
+        return escaped;
+    }
+
+    // The baseline is a file this class wrote, so a text scan is enough:
+    // a path's entry runs from its "name" to the next "name"
+    static bool FindPath(const std::string& json, const std::string& path, std::string& entry)
+    {
+        const std::string marker = "\"name\": \"" + path + "\"";
+        size_t start = json.find(marker);
+        if (start == std::string::npos)
+            return false;
+        size_t end = json.find("\"name\":", start + marker.size());
+        entry = json.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        return true;
+    }
+
+    static bool ReadMetric(const std::string& entry, const char* section, const char* metric, double& value)
+    {
+        size_t at = entry.find(std::string("\"") + section + "\"");
+        if (at == std::string::npos)
+            return false;
+        at = entry.find(std::string("\"") + metric + "\":", at);
+        if (at == std::string::npos)
+            return false;
+        value = strtod(entry.c_str() + entry.find(':', at) + 1, NULL);
+        return true;
+    }
+
+    static bool Check(const std::string& path, const char* label, const std::string& entry,
+        const char* section, const char* metric, float current, float thresholdPercent)
+    {
+        double base = 0.0;
+        if (!ReadMetric(entry, section, metric, base) || base <= 0.0)
+            return true;
+
+        double change = (current - base) / base * 100.0;
+        bool regressed = change > thresholdPercent;
+
+        char line[256];
+        snprintf(line, sizeof(line), "%s: %-10s %-8s %8.3f ms vs %8.3f ms baseline (%+6.1f%%, limit +%.1f%%)",
+            regressed ? "REGRESSION" : "INFO", path.c_str(), label, current, base, change, thresholdPercent);
+        std::cout << line << std::endl;
+        return !regressed;
+    }
+
+    std::string mRenderer;
+    float mTimestep;
+    int mFrames;
+    int mWarmup;
+    std::vector<BenchmarkResult> mResults;
+};
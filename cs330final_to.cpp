@@ -1,5 +1,11 @@
 #include <iostream>         
 #include <cstdlib>         
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
 #include <GL/glew.h>        
 #include <GLFW/glfw3.h> 
 
@@ -11,17 +17,60 @@
 //TEDDIE - include camera for viewing
 #include "tutorial_05_05/camera.h"
 //TEDDIE - include math for helpfulness with the cylinder
+#ifdef _WIN32
 #include <corecrt_math_defines.h>
+#else
+#define _USE_MATH_DEFINES
+#include <cmath>
+#endif
 
 //TEDDIE - includes for images
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+//TEDDIE - PNG output for headless frame captures
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
 #include "tutorial_05_05/sphere.h"
-#include "tutorial_05_05/SphereCite.h"
-#include "tutorial_05_05/cyl.h"
-#include "tutorial_05_05/coaster.h"
 #include "tutorial_05_05/lime.h"
 #include "tutorial_05_05/Bmp.h"
+//TEDDIE - cache for the procedural meshes so they are only built once
+//TEDDIE - every GL object goes through an owning wrapper that the tracker accounts for
+#include "gpu_resources.h"
+#include "mesh_registry.h"
+//TEDDIE - scene objects with cached world matrices
+#include "scene.h"
+//TEDDIE - shader programs with cached uniform locations
+#include "shader.h"
+//TEDDIE - linked program binaries saved to disk so later starts skip compiling
+#include "program_cache.h"
+//TEDDIE - sorted draw submission
+#include "render_queue.h"
+//TEDDIE - bounding sphere / box per mesh, tested against the view frustum every frame
+#include "frustum.h"
+//TEDDIE - coarser spheres / cylinders for objects that are small on screen
+#include "lod.h"
+//TEDDIE - any number of point lights, assigned to screen tile x depth slice clusters
+#include "light_clusters.h"
+//TEDDIE - albedo / normal / depth targets for the deferred path
+#include "gbuffer.h"
+//TEDDIE - key light depth map, only redrawn when the light or a caster moves
+#include "shadow_map.h"
+//TEDDIE - fragment shader invocations per frame, to see what the depth pre-pass saves
+#include "fragment_counter.h"
+//TEDDIE - offscreen EGL context + framebuffer for machines with no display
+#include "headless.h"
+//TEDDIE - CPU / GPU time per frame stage
+#include "profiler.h"
+//TEDDIE - vsync, frame cap and frame time spread; the only thing that swaps buffers
+#include "frame_pacer.h"
+//TEDDIE - scripted camera paths + frame time reports for regression runs
+#include "benchmark.h"
+//TEDDIE - textures decode on worker threads and stream in while the scene already draws
+#include "texture_loader.h"
+//TEDDIE - every material in one texture array so textures never split a draw
+#include "material_textures.h"
+//TEDDIE - SIMD flip / channel expansion / mip kernels (only included here for --bench-image)
+#include "image_ops.h"
 
 //TEDDIE - Set up namespace
 using namespace std;
@@ -30,6 +79,10 @@ using namespace std;
 #ifndef GLSL
 #define GLSL(Version, Source) "#version " #Version " core \n" #Source
 #endif
+//TEDDIE - GLSL shared by several shaders, spliced in after #version when a program is built
+#ifndef GLSL_CHUNK
+#define GLSL_CHUNK(Source) #Source "\n"
+#endif
 
 // Unnamed namespace
 namespace
@@ -42,25 +95,91 @@ namespace
     const int WINDOW_WIDTH = 1400;
     const int WINDOW_HEIGHT = 1000;
 
-    //TEDDIE - Structure mesh to store VAOs, VBOs, and Vertices
-    // Stores the GL data relative to a given mesh
-
-
+    //TEDDIE - Structure mesh to store the hand-made shapes
+    // Handles into the mesh registry, which owns the (indexed) GL data
     struct GLMesh
     {
+        MeshHandle cone;        // drink cones and light markers
+        MeshHandle plane;       // shelf
+        MeshHandle pyramid;     // inside lime
+        MeshHandle cube;        // morbid box
+        MeshHandle dome;        // dome thing 2
+    };
 
-        GLuint vao[20];         // Handle for the vertex array object
-        GLuint vbo[20];         // Handle for the vertex buffer object
-        GLuint nVertices[20];    // Number of indices of the mesh
+    //TEDDIE - command line options (see UParseOptions)
+    struct RunOptions
+    {
+        bool headless = false;              // render into an FBO with no window or display
+        int frames = 300;                   // frames to render in headless mode
+        std::vector<int> captureFrames;     // headless frames written out as PNG
+        std::string capturePrefix = "frame";
+        std::string textureDir = "C:/Users/teddi/OneDrive/Desktop/SNHU/CS330/FINAL/textures/";
+        std::string profilePrefix = "profile";  // profile dumps go to PREFIX.csv / PREFIX.json
+        std::string benchmark;              // path name or "all"; empty = no benchmark
+        int benchFrames = 600;              // measured frames per path
+        int benchWarmup = 60;               // unmeasured frames before each path
+        std::string benchOutput = "benchmark.json";
+        std::string baseline;               // earlier benchmark.json to compare against
+        RegressionThresholds thresholds = { 10.0f, 25.0f };   // % slower allowed for avg / p99
+        std::string benchImage;             // time the image kernels on this file and exit
+        size_t vramBudget = 0;              // bytes, warns when tracked GPU memory goes over; 0 = none
+        float lodError = 6.0f;              // pixels a LOD level's silhouette may be off by
+        bool lod = true;                    // false = always the finest level
+        std::string programCache = "programs";  // binaries go to PREFIX_label_hash.bin; empty = no cache
+        int lights = 0;                     // extra point lights scattered over the scene
+        std::string renderer = "forward";   // forward, deferred, or both (benchmark runs every path with each)
+        std::string depthPrepass = "off";   // on, off, or both (benchmark runs forward paths with and without)
+        int vsync = 1;                      // swap interval: 0 off, 1 on, -1 adaptive
+        float fpsCap = 0.0f;                // frames per second limit; 0 = none
     };
+    RunOptions gOptions;
 
-    // Main GLFW window
+    // Main GLFW window (stays null in headless mode)
     GLFWwindow* gWindow = nullptr;
+    //TEDDIE - headless mode renders here instead
+    HeadlessContext gHeadlessContext;
+    OffscreenTarget gOffscreen;
     // Triangle mesh data
     GLMesh gMesh;
 
+    //TEDDIE - procedural meshes (cylinders, coasters, spheres) built once at startup
+    MeshRegistry gMeshes;
+    //TEDDIE - each one is a LOD chain, finest level first
+    LodChain gCylinderLod;
+    LodChain gCoasterLod;
+    LodChain gLimeRindLod;
+    LodChain gOrbLod;
+    LodChain gLimeLod;
+
+    //TEDDIE - every object in the scene; transforms are only rebuilt when they change
+    SceneGraph gScene;
+    NodeId gLampNode = NO_PARENT;
+
+    //TEDDIE - draws for the current frame, sorted so binds are only issued when state changes
+    RenderQueue gRenderQueue;
+    //TEDDIE - objects outside the view never reach the queue
+    FrustumCuller gCuller;
+    //TEDDIE - level per object from its size on screen
+    LodSelector gLod;
+
+    //TEDDIE - key and fill first (unbounded), then any --lights point lights
+    std::vector<PointLight> gLights;
+    LightClusters gLightClusters;
+    //TEDDIE - tracked by UResizeWindow, the clusters map gl_FragCoord to tiles with it
+    glm::ivec2 gViewportSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    //TEDDIE - where each frame's time goes, dumped on exit or with F9
+    FrameProfiler gProfiler;
+    //TEDDIE - presents every frame, after waiting out the frame cap if there is one
+    FramePacer gPacer;
+
+    //TEDDIE - decodes on a thread pool, uploads through a PBO a little each frame
+    TextureLoader gTextures;
+    //TEDDIE - layer (or atlas rect) per material, all in one array bound once per frame
+    MaterialTextures gMaterials;
+
     //TEDDIE - Texture name initializing Texture
-    GLuint planeTex, morbidTex, drinkTex, sphereTex, limeTex, rindTex, corkTex, ceramicTex;
+    MaterialId planeTex, morbidTex, drinkTex, sphereTex, limeTex, rindTex, corkTex, ceramicTex;
     //TEDDIE - Set up for uv / texture coordinates
     glm::vec2 gUVScale(5.0f, 5.0f);
     //TEDDIE - set textures to clamp to edge
@@ -74,8 +193,85 @@ namespace
 
     //TEDDIE - Set up shader programs
 
-    GLuint gProgramId;
-    GLuint gLightId;
+    //TEDDIE - programs know their own active uniforms after linking
+    ShaderProgram gProgram("phong");
+    ShaderProgram gLightProgram("lamp");
+    //TEDDIE - deferred path: G-buffer fill, then one lighting pass over the screen
+    ShaderProgram gGBufferProgram("gbuffer");
+    ShaderProgram gDeferredProgram("deferred");
+    //TEDDIE - depth only, draws the casters into the shadow map
+    ShaderProgram gShadowProgram("shadow");
+    //TEDDIE - depth only, lays down the scene's depth before the forward pass shades it
+    ShaderProgram gDepthProgram("depth");
+
+    //TEDDIE - a program whose compile / link was issued but not checked yet, so the driver
+    //TEDDIE - can work on all of them (on its own threads with KHR_parallel_shader_compile)
+    //TEDDIE - while the meshes are built
+    struct PendingProgram
+    {
+        ShaderProgram* program;
+        GpuProgram object;
+        GpuShader vertex;
+        GpuShader fragment;
+        uint64_t key;
+        bool cached;        // loaded from a binary, nothing to wait for
+    };
+    std::vector<PendingProgram> gPendingPrograms;
+    ProgramCache gProgramCache;
+
+    //TEDDIE - time to first frame is measured from here (set first thing in main)
+    std::chrono::steady_clock::time_point gStartTime;
+    double gProgramMs = 0.0;            // spent issuing and finishing the programs
+    bool gFirstFrameDone = false;
+
+    //TEDDIE - Phong uniform locations, looked up once at load time
+    struct PhongUniforms
+    {
+        GLint uTexture;
+        GLint uShadowMap;
+    };
+    PhongUniforms gPhongLoc;
+
+    struct DeferredUniforms
+    {
+        GLint uGBufferTexture;      // material array in the G-buffer program
+        GLint uAlbedo;
+        GLint uNormal;
+        GLint uDepth;
+        GLint uInverseViewProjection;
+        GLint uShadowMap;
+    };
+    DeferredUniforms gDeferredLoc;
+
+    //TEDDIE - G toggles between the forward Phong pass and the deferred path at runtime
+    bool gDeferred = false;
+    GBuffer gGBuffer;
+
+    //TEDDIE - the key light's shadows, cached until the light or a shadow caster moves
+    ShadowMap gShadowMap;
+
+    //TEDDIE - Z toggles the forward path's depth pre-pass; fragment invocations show what it saves
+    bool gDepthPrepass = false;
+    FragmentCounter gFragments;
+
+    //TEDDIE - camera + light cluster data for every program, written once per frame into one
+    //TEDDIE - uniform buffer (the lights themselves are in the Lights buffer). std140: only mat4 / vec4 members so no padding surprises
+    struct FrameUniforms
+    {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::vec4 viewPosition;
+        glm::vec4 clusterTiles;     // tiles per pixel x / y, tile count x / y
+        glm::vec4 clusterSlices;    // see LightClusters::SliceParams, w = slice count
+        glm::vec4 lightCounts;      // x = unbounded lights at the front of the list
+        glm::mat4 shadowMatrix;     // world -> key light shadow map clip space
+    };
+    const GLuint FRAME_UNIFORMS_BINDING = 0;     // binding = 0 in frameDataShaderSource
+    //TEDDIE - shader storage bindings of the clustered lighting buffers (Phong shader)
+    const GLuint LIGHTS_BINDING = 1;
+    const GLuint LIGHT_CLUSTERS_BINDING = 2;
+    const GLuint LIGHT_INDICES_BINDING = 3;
+    GpuBuffer gFrameUbo;
 
 
    //TEDDIE - camera set up
@@ -117,19 +313,158 @@ namespace
  * and render graphics on the screen
  */
 bool UInitialize(int, char* [], GLFWwindow** window);
+bool UParseOptions(int argc, char* argv[], RunOptions& options);
+bool UInitializeHeadless();
+void URunHeadless();
+void UCaptureFrame(int frame);
+void UWriteProfile();
+void UReportGpuResources();
+double UTimeKernel(const std::function<void()>& kernel);
+void UReportKernel(const char* name, double scalarMs, double simdMs, double threadedMs, bool matches);
+std::vector<CameraPath> UCreateBenchmarkPaths();
+bool URunBenchmark();
+bool UBenchmarkImageOps(const std::string& filename);
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UCreateMesh(GLMesh& mesh);
-void UDestroyMesh(GLMesh& mesh);
-bool UCreateTexture(const char* filename, GLuint& textureId);
-void UDestroyTexture(GLuint textureId);
+void UCreatePrimitives();
+void UCreateScene();
+bool UCreateTexture(const char* filename, MaterialId& material);
 void URender();
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
-void UDestroyShaderProgram(GLuint programId);
+void URenderDeferred(const glm::mat4& viewProjection);
+void UReportRenderStats();
+std::string UAssembleShader(const char* source, const char* chunk);
+bool UQueueShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, ShaderProgram& program, const char* fragChunk = nullptr);
+bool UFinishShaderPrograms();
+void UReportFirstFrame();
+void UDestroyShaderProgram(ShaderProgram& program);
+void UCreateFrameUniforms();
+void UAimShadowMap();
+void URenderDepthPrepass();
+void URenderShadowMap();
+void UUpdateFrameUniforms(const glm::mat4& view, const glm::mat4& projection);
+void UCreateLights();
+
+
+
+
+//TEDDIE - camera and light data shared by every program, written once per frame from FrameUniforms.
+//TEDDIE - UQueueShaderProgram puts it at the top of every shader, so there is only this one copy
+const GLchar* frameDataShaderSource = GLSL_CHUNK(
+
+	layout(std140, binding = 0) uniform FrameData
+	{
+		mat4 view;
+		mat4 projection;
+		vec4 viewPosition;
+		vec4 clusterTiles;     // tiles per pixel x / y, tile count x / y
+		vec4 clusterSlices;    // slice = floor(d * x + y), d = log(view depth) when z is 1; w = slices
+		vec4 lightCounts;      // x = unbounded lights at the front of the light list
+		mat4 shadowMatrix;     // world -> key light shadow map clip space
+	};
+);
+//TEDDIE - std140 packs mat4 / vec4 members back to back, so this catches a member added on one side only
+static_assert(sizeof(FrameUniforms) == 3 * sizeof(glm::mat4) + 4 * sizeof(glm::vec4),
+    "FrameUniforms and frameDataShaderSource must declare the same members in the same order");
+
+
+//TEDDIE - lights, clusters and shadow lookup shared by the Phong and deferred lighting shaders,
+//TEDDIE - spliced in after FrameData so both shade a point the same way
+const GLchar* lightingShaderSource = GLSL_CHUNK(
+
+	uniform sampler2DShadow uShadowMap; //TEDDIE - key light depth, compared in hardware
+
+	//TEDDIE - every light, layout must match PointLight. Radius 0 = unbounded (the key and fill lights)
+	struct PointLight
+	{
+		vec4 positionRadius;
+		vec4 colorAmbient;
+		vec4 specular;
+	};
+	layout(std430, binding = 1) readonly buffer Lights
+	{
+		PointLight lights[];
+	};
+	//TEDDIE - offset / count into lightIndices for every cluster, filled by LightClusters on the CPU
+	layout(std430, binding = 2) readonly buffer LightClusters
+	{
+		uvec2 clusters[];
+	};
+	layout(std430, binding = 3) readonly buffer LightIndices
+	{
+		uint lightIndices[];
+	};
+
+//TEDDIE - how much of the key light reaches position: 3x3 taps of the shadow map, each one a
+//TEDDIE - bilinear 2x2 depth comparison, so edges get a soft 4x4 texel falloff
+float UShadow(vec3 position, vec3 norm)
+{
+    //TEDDIE - nudged along the normal so surfaces facing away from the light don't shadow themselves
+    vec4 shadowClip = shadowMatrix * vec4(position + norm * 0.01f, 1.0f);
+    vec3 shadowCoord = shadowClip.xyz / shadowClip.w * 0.5f + 0.5f;
+    if (shadowClip.w <= 0.0f || shadowCoord.z >= 1.0f)
+        return 1.0f;
+
+    vec2 texel = 1.0f / vec2(textureSize(uShadowMap, 0));
+    float lit = 0.0f;
+    for (int y = -1; y <= 1; ++y)
+        for (int x = -1; x <= 1; ++x)
+            lit += textureLod(uShadowMap, vec3(shadowCoord.xy + vec2(x, y) * texel, shadowCoord.z), 0.0f);
+    return lit / 9.0f;
+}
 
+//TEDDIE - phong lighting for ambient, diffuse and spec lighting from one light; shadow only
+//TEDDIE - dims diffuse and spec, ambient still reaches shadowed surfaces
+vec3 UShadeLight(PointLight light, vec3 position, vec3 norm, vec3 viewDir, float shadow)
+{
+    //TEDDIE - calc light distancing
+    vec3 toLight = light.positionRadius.xyz - position;
+    vec3 lightDirection = normalize(toLight);
 
+    //TEDDIE - bounded lights fade out smoothly at their radius
+    float attenuation = 1.0f;
+    if (light.positionRadius.w > 0.0f)
+    {
+        float falloff = clamp(1.0f - dot(toLight, toLight) / (light.positionRadius.w * light.positionRadius.w), 0.0f, 1.0f);
+        attenuation = falloff * falloff;
+    }
+
+    //TEDDIE - amb light color
+    vec3 ambient = light.colorAmbient.w * light.colorAmbient.rgb;
+    //TEDDIE - calc diffuse impact
+    float impact = max(dot(norm, lightDirection), 0.0);
+    vec3 diffuse = impact * light.colorAmbient.rgb;
+    //TEDDIE - reflection vector calcs, spec component calcs
+    vec3 reflectDir = reflect(-lightDirection, norm);
+    float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), light.specular.y);
+    vec3 specular = light.specular.x * specularComponent * light.colorAmbient.rgb;
+
+    return attenuation * (ambient + shadow * (diffuse + specular));
+}
+
+//TEDDIE - every light reaching a world space position
+vec3 ULighting(vec3 position, vec3 norm, vec3 viewDir)
+{
+    //TEDDIE - unbounded lights (key and fill) light everything; light 0 is the key light, the
+    //TEDDIE - only one with a shadow map
+    vec3 lightingResult = vec3(0.0f);
+    int globalLights = int(lightCounts.x);
+    for (int i = 0; i < globalLights; ++i)
+        lightingResult += UShadeLight(lights[i], position, norm, viewDir, i == 0 ? UShadow(position, norm) : 1.0f);
+
+    //TEDDIE - the rest only through the cluster this fragment falls in: screen tile + depth slice
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterTiles.xy), ivec2(clusterTiles.zw) - 1);
+    float viewDepth = -(view * vec4(position, 1.0f)).z;
+    float sliceDepth = clusterSlices.z > 0.5f ? log(max(viewDepth, 1e-4f)) : viewDepth;
+    int slice = clamp(int(floor(sliceDepth * clusterSlices.x + clusterSlices.y)), 0, int(clusterSlices.w) - 1);
+    uvec2 cluster = clusters[(slice * int(clusterTiles.w) + tile.y) * int(clusterTiles.z) + tile.x];
+    for (uint i = 0u; i < cluster.y; ++i)
+        lightingResult += UShadeLight(lights[lightIndices[cluster.x + i]], position, norm, viewDir, 1.0f);
+    return lightingResult;
+}
+);
 
 
 /* Vertex Shader Source Code*/
@@ -143,10 +478,19 @@ const GLchar* vertexShaderSource = GLSL(440,
 	out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
 	out vec2 vertexTextureCoordinate;
 
-	//Uniform / Global variables for the  transform matrices
-	uniform mat4 model;
-	uniform mat4 view;
-	uniform mat4 projection;
+	//TEDDIE - per-instance model matrix, streamed by the render queue (locations 3-6)
+	layout(location = 3) in mat4 model;
+	//TEDDIE - per-instance normal matrix worked out on the CPU once per object (locations 7-9)
+	layout(location = 7) in mat3 normalMatrix;
+	//TEDDIE - where this object's material sits in the texture array: rect, then layer + max lod
+	layout(location = 10) in vec4 uvRect;
+	layout(location = 11) in vec2 layerLod;
+	flat out vec4 vertexUvRect;
+	flat out vec2 vertexLayerLod;
+
+
+	//TEDDIE - same position math as the depth pre-pass, bit for bit, so its GL_EQUAL test passes
+	invariant gl_Position;
 
 void main()
 {
@@ -154,8 +498,10 @@ void main()
 
 	vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
 
-	vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
+	vertexNormal = normalMatrix * normal; // get normal vectors in world space only and exclude normal translation properties
 	vertexTextureCoordinate = textureCoordinate;
+	vertexUvRect = uvRect;
+	vertexLayerLod = layerLod;
 }
 );
 
@@ -165,90 +511,28 @@ const GLchar* fragmentShaderSource = GLSL(440,
 	in vec3 vertexNormal; // For incoming normals
 	in vec3 vertexFragmentPos; // For incoming fragment position
 	in vec2 vertexTextureCoordinate;
+	flat in vec4 vertexUvRect;
+	flat in vec2 vertexLayerLod;
 
 	out vec4 fragmentColor; // For outgoing cube color to the GPU
 	out vec4 fillFragmentColor;
-	// Uniform / Global variables for light color, light position, and camera/view position
-	uniform vec3 objectColor;
-	uniform vec3 lightColor;
-	uniform vec3 lightPos;
-	uniform vec3 fillColor;
-	uniform vec3 fillPos;
-	uniform vec3 viewPosition;
-	uniform sampler2D uTexture; // Useful when working with multiple textures
-	uniform vec2 uvScale;
+	uniform sampler2DArray uTexture; //TEDDIE - every material, one layer or atlas rect each
 
 void main()
 {
-    //TEDDIE - phong lighting for ambient, diffuse and spec lighting
-    // 
-    //TEDDIE - key lighting calculations
-    //TEDDIE - amb lighting strength for key light at 50%
-    float ambientStrength = 0.2f; 
-    //TEDDIE - amb light color
-    vec3 ambient = ambientStrength * lightColor;
-
-    //TEDDIE - Diffuse lighting
     //TEDDIE -  norm vectors to 1
     vec3 norm = normalize(vertexNormal);
-    //TEDDIE - calc light distancing 
-    vec3 lightDirection = normalize(lightPos - vertexFragmentPos); 
-    //TEDDIE - calc diffuse impact
-    float impact = max(dot(norm, lightDirection), 0.0);
-    //TEDDIE - difuse light color
-    vec3 diffuse = impact * lightColor;
-
-    //TEDDIE - specular lighting - spec
-    //TEDDIE - spec light strength
-    float specularIntensity = 0.3f; 
-    //TEDDIE - highlight sizing
-    float highlightSize = 2.0f;
     //TEDDIE - view direction
-    vec3 viewDir = normalize(viewPosition - vertexFragmentPos);
-    //TEDDIE - reflection vector calcs
-    vec3 reflectDir = reflect(-lightDirection, norm);
-    //TEDDIE - spec component calcs
-    float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
-    //TEDDIE - spec calcs
-    vec3 specular = specularIntensity * specularComponent * lightColor;
+    vec3 viewDir = normalize(viewPosition.xyz - vertexFragmentPos);
+    vec3 lightingResult = ULighting(vertexFragmentPos, norm, viewDir);
 
-
-    //TEDDIE - Fill lighting
-    //TEDDIE -  ambient fill strength
-    float fillAmbientStrength = 0.1f; 
-    //TEDDIE - amb light color
-    vec3 fillAmbient = fillAmbientStrength * fillColor; 
-
-
-    //TEDDIE - calc light distancing 
-    vec3 fillDirection = normalize(fillPos - vertexFragmentPos); 
-    //TEDDIE - calc diffuse impact
-    float fillImpact = max(dot(norm, fillDirection), 0.0);
-    //TEDDIE - calc diffuse impact
-    vec3 fillDiffuse = fillImpact * fillColor; 
-
-    //TEDDIE - specular fill lighting - spec
-    //TEDDIE - spec light strength
-    float fillSpecularIntensity = 0.5f; 
-    //TEDDIE - highlight sizing
-    float fillHighlightSize = 8.0f; 
-    //TEDDIE - view direction
-    vec3 fillViewDir = normalize(viewPosition - vertexFragmentPos); 
-    //TEDDIE - reflection vector calcs
-    vec3 fillReflectDir = reflect(-fillDirection, norm);
-    //TEDDIE - spec component calcs
-    float fillSpecularComponent = pow(max(dot(fillViewDir, fillReflectDir), 0.0), fillHighlightSize);
-    //TEDDIE - spec calcs
-    vec3 fillSpecular = fillSpecularIntensity * fillSpecularComponent * fillColor;
+    //TEDDIE - repeat inside the material's rect; lod comes from the unwrapped coords so the wrap seam
+    //TEDDIE - keeps its mip level and is capped so packed neighbours never bleed in
+    vec2 materialUV = vertexUvRect.xy + fract(vertexTextureCoordinate) * vertexUvRect.zw;
+    float lod = min(textureQueryLod(uTexture, vertexTextureCoordinate * vertexUvRect.zw).y, vertexLayerLod.y);
 
     //TEDDIE - calc Phong results
-    vec3 objectColor = texture(uTexture, vertexTextureCoordinate).xyz;
-    //TEDDIE - key light totals
-    vec3 keyResult = (ambient + diffuse + specular);
-    //TEDDIE - fill light totals
-    vec3 fillResult = (fillAmbient + fillDiffuse + fillSpecular);
-    //TEDDIE - all lighting totals
-    vec3 lightingResult = keyResult + fillResult;
+    vec3 objectColor = textureLod(uTexture, vec3(materialUV, vertexLayerLod.x), lod).xyz;
     //TEDDIE - phong results
     vec3 phong = (lightingResult)*objectColor;
 
@@ -258,156 +542,281 @@ void main()
 );
 
 
-/* Lamp Shader Source Code*/
-const GLchar* lampVertexShaderSource = GLSL(440,
+//TEDDIE - deferred path, geometry pass: same vertex shader as Phong, writes what the lighting
+//TEDDIE - pass needs instead of shading (depth comes from the depth attachment)
+const GLchar* gbufferFragmentShaderSource = GLSL(440,
 
-    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+	in vec3 vertexNormal;
+	in vec3 vertexFragmentPos;
+	in vec2 vertexTextureCoordinate;
+	flat in vec4 vertexUvRect;
+	flat in vec2 vertexLayerLod;
+
+	layout(location = 0) out vec4 gAlbedo;
+	layout(location = 1) out vec4 gNormal;     // world normal * 0.5 + 0.5
 
-        //Uniform / Global variables for the  transform matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+	uniform sampler2DArray uTexture; //TEDDIE - every material, one layer or atlas rect each
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+    //TEDDIE - same material lookup as the Phong shader
+    vec2 materialUV = vertexUvRect.xy + fract(vertexTextureCoordinate) * vertexUvRect.zw;
+    float lod = min(textureQueryLod(uTexture, vertexTextureCoordinate * vertexUvRect.zw).y, vertexLayerLod.y);
+
+    gAlbedo = vec4(textureLod(uTexture, vec3(materialUV, vertexLayerLod.x), lod).xyz, 1.0f);
+    gNormal = vec4(normalize(vertexNormal) * 0.5f + 0.5f, 1.0f);
 }
 );
 
 
-/* Fragment Shader Source Code*/
-const GLchar* lampFragmentShaderSource = GLSL(440,
+//TEDDIE - deferred path, lighting pass: one triangle over the whole screen
+const GLchar* deferredVertexShaderSource = GLSL(440,
 
-    out vec4 fragmentColor; // For outgoing lamp color (smaller cube) to the GPU
+	out vec2 screenUV;
 
 void main()
 {
-    fragmentColor = vec4(1.0f); // Set color to white (1.0f,1.0f,1.0f) with alpha 1.0
+    //TEDDIE - vertices 0 1 2 -> uv (0 0) (2 0) (0 2), the triangle covers the whole viewport
+    screenUV = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+    gl_Position = vec4(screenUV * 2.0f - 1.0f, 0.0f, 1.0f);
 }
 );
 
 
-const GLchar* fillVertexShaderSource = GLSL(440,
+//TEDDIE - deferred path, lighting pass: every pixel shaded once from the G-buffer, with the same
+//TEDDIE - lightingShaderSource as the Phong shader
+const GLchar* deferredFragmentShaderSource = GLSL(440,
 
-    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+	in vec2 screenUV;
 
-        //Uniform / Global variables for the  transform matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+	out vec4 fragmentColor;
+
+
+	uniform sampler2D uAlbedo;
+	uniform sampler2D uNormal;
+	uniform sampler2D uDepth;
+	uniform mat4 uInverseViewProjection;     //TEDDIE - depth buffer back to world space
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+    //TEDDIE - nothing was drawn here, leave the clear colour
+    float depth = texture(uDepth, screenUV).r;
+    if (depth >= 1.0f)
+        discard;
+    //TEDDIE - the forward pass after this one (lamp marker) depth tests against the scene
+    gl_FragDepth = depth;
+
+    vec4 world = uInverseViewProjection * vec4(vec3(screenUV, depth) * 2.0f - 1.0f, 1.0f);
+    vec3 position = world.xyz / world.w;
+    vec3 norm = normalize(texture(uNormal, screenUV).xyz * 2.0f - 1.0f);
+    vec3 viewDir = normalize(viewPosition.xyz - position);
+
+    vec3 lightingResult = ULighting(position, norm, viewDir);
+
+    fragmentColor = vec4(lightingResult * texture(uAlbedo, screenUV).rgb, 1.0f);
 }
 );
 
 
-/* Fragment Shader Source Code*/
-const GLchar* fillFragmentShaderSource = GLSL(440,
+//TEDDIE - depth pre-pass: the scene's depth only, so the shading pass after it runs the fragment
+//TEDDIE - shader once per pixel (GL_EQUAL) instead of once per overlapping surface
+const GLchar* depthVertexShaderSource = GLSL(440,
+
+    layout(location = 0) in vec3 position;
+
+    //TEDDIE - per-instance model matrix, streamed by the render queue (locations 3-6)
+    layout(location = 3) in mat4 model;
 
-    out vec4 fragmentColor; // For outgoing lamp color (smaller cube) to the GPU
+
+    //TEDDIE - must match the shading pass exactly, see vertexShaderSource
+    invariant gl_Position;
 
 void main()
 {
-    fragmentColor = vec4(1.0f); // Set color to white (1.0f,1.0f,1.0f) with alpha 1.0
+    gl_Position = projection * view * model * vec4(position, 1.0f);
 }
 );
 
 
+//TEDDIE - shadow pass: casters' depth as seen from the key light, nothing else
+const GLchar* shadowVertexShaderSource = GLSL(440,
+
+    layout(location = 0) in vec3 position;
 
-// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
-void flipImageVertically(unsigned char* image, int width, int height, int channels)
+    //TEDDIE - per-instance model matrix, streamed by the render queue (locations 3-6)
+    layout(location = 3) in mat4 model;
+
+
+void main()
 {
-    for (int j = 0; j < height / 2; ++j)
-    {
-        int index1 = j * width * channels;
-        int index2 = (height - 1 - j) * width * channels;
+    gl_Position = shadowMatrix * model * vec4(position, 1.0f);
+}
+);
 
-        for (int i = width * channels; i > 0; --i)
-        {
-            unsigned char tmp = image[index1];
-            image[index1] = image[index2];
-            image[index2] = tmp;
-            ++index1;
-            ++index2;
-        }
-    }
+
+//TEDDIE - shadow map and depth pre-pass: no colour attachment / colour writes off
+const GLchar* depthOnlyFragmentShaderSource = GLSL(440,
+
+void main()
+{
+    //TEDDIE - depth is written by the fixed function, no colour attachment
 }
+);
 
 
-int main(int argc, char* argv[])
+/* Lamp Shader Source Code*/
+const GLchar* lampVertexShaderSource = GLSL(440,
+
+    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+
+    //TEDDIE - per-instance model matrix, streamed by the render queue (locations 3-6)
+    layout(location = 3) in mat4 model;
+
+
+    //TEDDIE - same position math as the depth pre-pass, bit for bit, so its GL_EQUAL test passes
+    invariant gl_Position;
+
+void main()
 {
-    if (!UInitialize(argc, argv, &gWindow))
-        return EXIT_FAILURE;
+    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+}
+);
 
-    // Create the mesh
-    UCreateMesh(gMesh); // Calls the function to create the Vertex Buffer Object
 
+/* Fragment Shader Source Code*/
+const GLchar* lampFragmentShaderSource = GLSL(440,
 
+    out vec4 fragmentColor; // For outgoing lamp color (smaller cube) to the GPU
 
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
-        return EXIT_FAILURE;
-    if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLightId))
+void main()
+{
+    fragmentColor = vec4(1.0f); // Set color to white (1.0f,1.0f,1.0f) with alpha 1.0
+}
+);
+
+
+int main(int argc, char* argv[])
+{
+    gStartTime = std::chrono::steady_clock::now();
+
+    if (!UParseOptions(argc, argv, gOptions))
         return EXIT_FAILURE;
+    GpuResources().SetBudget(gOptions.vramBudget);
+    gLod.SetPixelError(gOptions.lodError);
+    gLod.SetEnabled(gOptions.lod);
+    //TEDDIE - --bench-image only times CPU kernels, no window or GL needed
+    if (!gOptions.benchImage.empty())
+        return UBenchmarkImageOps(gOptions.benchImage) ? EXIT_SUCCESS : EXIT_FAILURE;
 
-    //TEDDIE -  try nwe way for texture loading due to repeated issues
-    const char* planeTexFilename = "C:/Users/teddi/OneDrive/Desktop/SNHU/CS330/FINAL/textures/plane.jpg";
-    const char* morbidTexFilename = "C:/Users/teddi/OneDrive/Desktop/SNHU/CS330/FINAL/textures/box.jpg";
-    const char* drinkTexFilename = "C:/Users/teddi/OneDrive/Desktop/SNHU/CS330/FINAL/textures/drink.jpg";
-    const char* sphereTexFilename = "C:/Users/teddi/OneDrive/Desktop/SNHU/CS330/FINAL/textures/sphere.jpg";
-    const char* limeTexFilename = "C:/Users/teddi/OneDrive/Desktop/SNHU/CS330/FINAL/textures/lime.jpg";
-    const char* rindTexFilename = "C:/Users/teddi/OneDrive/Desktop/SNHU/CS330/FINAL/textures/rind.jpg";
-    const char* corkTexFilename = "C:/Users/teddi/OneDrive/Desktop/SNHU/CS330/FINAL/textures/cork.jpg";
-    const char* ceramicTexFilename = "C:/Users/teddi/OneDrive/Desktop/SNHU/CS330/FINAL/textures/ceramic.jpg";
-
-    if (!UCreateTexture(planeTexFilename, planeTex))
-    {
-        cout << "Failed to load texture " << planeTexFilename << endl;
+    if (!UInitialize(argc, argv, &gWindow))
         return EXIT_FAILURE;
-    }
-    if (!UCreateTexture(morbidTexFilename, morbidTex))
-    {
-        cout << "Failed to load texture " << morbidTexFilename << endl;
+    gPacer.Init(gWindow, gOptions.vsync, gOptions.fpsCap);
+
+    //TEDDIE - programs come from the binary cache or start compiling now, and are only
+    //TEDDIE - checked after the meshes are built so the compiles overlap that work
+    gProgramCache.Init(gOptions.programCache);
+    if (GLEW_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);     // as many threads as the driver likes
+    if (!UQueueShaderProgram(vertexShaderSource, fragmentShaderSource, gProgram, lightingShaderSource))
         return EXIT_FAILURE;
-    }
-    if (!UCreateTexture(drinkTexFilename, drinkTex))
-    {
-        cout << "Failed to load texture " << drinkTexFilename << endl;
+    if (!UQueueShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLightProgram))
         return EXIT_FAILURE;
-    }
-    if (!UCreateTexture(sphereTexFilename, sphereTex))
-    {
-        cout << "Failed to load texture " << sphereTexFilename << endl;
+    if (!UQueueShaderProgram(vertexShaderSource, gbufferFragmentShaderSource, gGBufferProgram))
         return EXIT_FAILURE;
-    }
-    if (!UCreateTexture(limeTexFilename, limeTex))
-    {
-        cout << "Failed to load texture " << limeTexFilename << endl;
+    if (!UQueueShaderProgram(deferredVertexShaderSource, deferredFragmentShaderSource, gDeferredProgram, lightingShaderSource))
         return EXIT_FAILURE;
-    }
-    if (!UCreateTexture(rindTexFilename, rindTex))
-    {
-        cout << "Failed to load texture " << rindTexFilename << endl;
+    if (!UQueueShaderProgram(shadowVertexShaderSource, depthOnlyFragmentShaderSource, gShadowProgram))
         return EXIT_FAILURE;
-    }
-    if (!UCreateTexture(corkTexFilename, corkTex))
-    {
-        cout << "Failed to load texture " << corkTexFilename << endl;
+    if (!UQueueShaderProgram(depthVertexShaderSource, depthOnlyFragmentShaderSource, gDepthProgram))
         return EXIT_FAILURE;
-    }
-    if (!UCreateTexture(ceramicTexFilename, ceramicTex))
-    {
-        cout << "Failed to load texture " << ceramicTexFilename << endl;
+
+    // Create the mesh
+    UCreateMesh(gMesh); // Calls the function to create the Vertex Buffer Object
+    //TEDDIE - generate and upload the procedural meshes once instead of every frame
+    UCreatePrimitives();
+
+    if (!UFinishShaderPrograms())
+        return EXIT_FAILURE;
+
+    //TEDDIE - resolve every uniform the frame loop sets, warns about misspelled / inactive names
+    gPhongLoc.uTexture = gProgram.Uniform("uTexture");
+    gPhongLoc.uShadowMap = gProgram.Uniform("uShadowMap");
+    gDeferredLoc.uGBufferTexture = gGBufferProgram.Uniform("uTexture");
+    gDeferredLoc.uAlbedo = gDeferredProgram.Uniform("uAlbedo");
+    gDeferredLoc.uNormal = gDeferredProgram.Uniform("uNormal");
+    gDeferredLoc.uDepth = gDeferredProgram.Uniform("uDepth");
+    gDeferredLoc.uInverseViewProjection = gDeferredProgram.Uniform("uInverseViewProjection");
+    gDeferredLoc.uShadowMap = gDeferredProgram.Uniform("uShadowMap");
+    gProgram.ReportUnused();
+    gLightProgram.ReportUnused();
+    gGBufferProgram.ReportUnused();
+    gDeferredProgram.ReportUnused();
+    gShadowProgram.ReportUnused();
+    gDepthProgram.ReportUnused();
+
+    //TEDDIE - one uniform buffer holds the camera and lights for all three programs
+    UCreateFrameUniforms();
+    //TEDDIE - light list + cluster buffers for the Phong shader
+    UCreateLights();
+    //TEDDIE - drawn for the first time by the first frame, then only when something moves
+    if (!gShadowMap.Create())
         return EXIT_FAILURE;
+    gFragments.Init();
+    if (!gFragments.Supported())
+        cout << "WARNING: No GL_ARB_pipeline_statistics_query, fragment invocations not counted" << endl;
+
+    //TEDDIE -  try nwe way for texture loading due to repeated issues
+    //TEDDIE - UCreateTexture only queues the file now, the names are valid straight away
+    gTextures.Init();
+    //TEDDIE - folder comes from --textures so other machines can find them too
+    //TEDDIE - only a missing file stops startup here; one that will not decode is reported by
+    //TEDDIE - gTextures when it gets to it and keeps the placeholder grey
+    struct TextureFile
+    {
+        const char* name;
+        MaterialId* material;
+    };
+    const TextureFile textureFiles[] = {
+        { "plane.jpg", &planeTex },
+        { "box.jpg", &morbidTex },
+        { "drink.jpg", &drinkTex },
+        { "sphere.jpg", &sphereTex },
+        { "lime.jpg", &limeTex },
+        { "rind.jpg", &rindTex },
+        { "cork.jpg", &corkTex },
+        { "ceramic.jpg", &ceramicTex },
+    };
+    for (size_t i = 0; i < sizeof(textureFiles) / sizeof(textureFiles[0]); ++i)
+    {
+        const std::string filename = gOptions.textureDir + textureFiles[i].name;
+        if (!UCreateTexture(filename.c_str(), *textureFiles[i].material))
+        {
+            cout << "Texture not found: " << filename << endl;
+            return EXIT_FAILURE;
+        }
     }
 
   
 
-    //TEDDIE - set texture to which program
-    glUseProgram(gProgramId);
+    //TEDDIE - lay out every object once; URender just walks the list
+    UCreateScene();
+    //TEDDIE - hook the per-instance matrix buffer into every mesh
+    gRenderQueue.Init(gMeshes);
+
+    //TEDDIE - lay the materials out in the array and start streaming them into their layers
+    if (!gMaterials.Build(gTextures))
+        return EXIT_FAILURE;
+
     //TEDDIE - set unit as 0
-    glUniform1i(glGetUniformLocation(gProgramId, "uTexture"), 0);
+    gProgram.Set(gPhongLoc.uTexture, 0);
+    gGBufferProgram.Set(gDeferredLoc.uGBufferTexture, 0);
+    gDeferredProgram.Set(gDeferredLoc.uAlbedo, (int)GBuffer::ALBEDO_UNIT);
+    gDeferredProgram.Set(gDeferredLoc.uNormal, (int)GBuffer::NORMAL_UNIT);
+    gDeferredProgram.Set(gDeferredLoc.uDepth, (int)GBuffer::DEPTH_UNIT);
+    gProgram.Set(gPhongLoc.uShadowMap, (int)ShadowMap::UNIT);
+    gDeferredProgram.Set(gDeferredLoc.uShadowMap, (int)ShadowMap::UNIT);
+    gDeferred = gOptions.renderer == "deferred";
+    gDepthPrepass = gOptions.depthPrepass == "on";
 
     //TEDDIE - set background o black
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -415,7 +824,20 @@ int main(int argc, char* argv[])
     // render loop
     // -----------
 
-    while (!glfwWindowShouldClose(gWindow))
+    //TEDDIE - measured / captured runs start with every texture resident
+    if (!gOptions.benchmark.empty() || gOptions.headless)
+        gTextures.Finish();
+
+    //TEDDIE - benchmark: scripted camera paths, then shut down (fails on regressions)
+    //TEDDIE - headless: fixed number of frames into the FBO, then shut down
+    bool passed = true;
+    if (!gOptions.benchmark.empty())
+        passed = URunBenchmark();
+    else if (gOptions.headless)
+        URunHeadless();
+
+    const bool interactive = gWindow && gOptions.benchmark.empty();
+    while (interactive && !glfwWindowShouldClose(gWindow))
     {
         // per-frame timing
         // --------------------
@@ -423,41 +845,80 @@ int main(int argc, char* argv[])
         gDeltaTime = currentFrame - gLastFrame;
         gLastFrame = currentFrame;
 
+        gProfiler.BeginFrame();
+        gProfiler.Begin("frame");
+
         // input
         // -----
+        gProfiler.Begin("input");
         UProcessInput(gWindow);
+        gProfiler.End();
 
         // Render this frame
         URender();
+        UReportRenderStats();
 
+        gProfiler.Begin("events");
         glfwPollEvents();
+        gProfiler.End();
+
+        gProfiler.End();
+        gProfiler.EndFrame();
     }
 
-    // Release mesh data
-    UDestroyMesh(gMesh);
+    //TEDDIE - keep the last profile of every run, windowed or headless
+    UWriteProfile();
+    if (interactive)
+    {
+        const PacingStats pacing = gPacer.Stats();
+        cout << "INFO: Frame pacing over the last " << pacing.frames << " frames: " << pacing.meanMs << " ms mean, "
+            << pacing.stdDevMs << " ms std dev, " << pacing.maxMs << " ms max" << endl;
+    }
+    gProfiler.Release();
+    gFragments.Release();
+    //TEDDIE - what the run ended up holding on the GPU, before it is all released
+    UReportGpuResources();
 
-    //TEDDIE - release textures
-    UDestroyTexture(planeTex);
-    UDestroyTexture(morbidTex);
-    UDestroyTexture(drinkTex);
-    UDestroyTexture(sphereTex);
-    UDestroyTexture(limeTex);
-    UDestroyTexture(rindTex);
-    UDestroyTexture(corkTex);
-    UDestroyTexture(ceramicTex);
+    // Release mesh data (the registry owns every mesh's buffers)
+    gMeshes.Release();
+    gRenderQueue.Release();
+    gTextures.Release();
+
+    //TEDDIE - release textures (the array holds every material)
+    gMaterials.Release();
+    gLightClusters.Release();
 
     //TEDDIE - release shaders
-    UDestroyShaderProgram(gProgramId);
-    UDestroyShaderProgram(gLightId);
+    UDestroyShaderProgram(gProgram);
+    UDestroyShaderProgram(gLightProgram);
+    UDestroyShaderProgram(gGBufferProgram);
+    UDestroyShaderProgram(gDeferredProgram);
+    UDestroyShaderProgram(gShadowProgram);
+    UDestroyShaderProgram(gDepthProgram);
+    gGBuffer.Release();
+    gShadowMap.Release();
+    gFrameUbo.Reset();
+
+    if (gOptions.headless)
+        gOffscreen.Destroy();
+
+    //TEDDIE - everything is released by now, whatever the tracker still has leaked
+    GpuResources().ReportLeaks();
 
+    if (gOptions.headless)
+        gHeadlessContext.Destroy();
 
-    exit(EXIT_SUCCESS); // Terminates the program successfully
+
+    exit(passed ? EXIT_SUCCESS : EXIT_FAILURE); // Terminates the program successfully
 }
 
 
 // Initialize GLFW, GLEW, and create a window
 bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 {
+    if (gOptions.headless)
+        return UInitializeHeadless();
+
     // GLFW: initialize and configure
     // ------------------------------
     glfwInit();
@@ -505,6 +966,488 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
     return true;
 }
 
+
+//TEDDIE - command line:
+//TEDDIE -   --headless             render offscreen (EGL, no window / display / GPU needed)
+//TEDDIE -   --frames N             frames to render in headless mode (default 300)
+//TEDDIE -   --capture N            save headless frame N as PNG, can be repeated
+//TEDDIE -   --capture-prefix PATH  PNG names become PATH_N.png (default "frame")
+//TEDDIE -   --textures DIR         folder holding the texture jpgs
+//TEDDIE -   --bench-image FILE     time the image kernels (scalar vs SIMD vs threaded) on FILE and exit
+//TEDDIE -   --profile PREFIX       profile dumps go to PREFIX.csv / PREFIX.json (default "profile")
+//TEDDIE -   --benchmark NAME       replay camera path NAME (orbit, topdown, coasters) or "all"
+//TEDDIE -   --bench-frames N       measured frames per path (default 600), 1/60 s apart
+//TEDDIE -   --bench-warmup N       frames rendered before measuring each path (default 60)
+//TEDDIE -   --bench-output FILE    results as JSON (default benchmark.json)
+//TEDDIE -   --baseline FILE        compare with an earlier results file, exit code 1 on regression
+//TEDDIE -   --fail-avg PCT         allowed avg slowdown vs baseline (default 10)
+//TEDDIE -   --fail-p99 PCT         allowed p99 slowdown vs baseline (default 25)
+//TEDDIE -   --vram-budget MB       warn when tracked GPU memory goes over MB
+//TEDDIE -   --lod-error PX         silhouette error in pixels before a coarser LOD is used (default 6)
+//TEDDIE -   --no-lod               always draw the finest level of every primitive
+//TEDDIE -   --program-cache PREFIX program binaries go to PREFIX_label_hash.bin (default "programs")
+//TEDDIE -   --no-program-cache     always compile the shaders from source
+//TEDDIE -   --lights N             add N point lights around the scene (clustered, default 0)
+//TEDDIE -   --renderer NAME        forward (default), deferred, or both to benchmark every path with each
+//TEDDIE -   --depth-prepass MODE   on, off (default), or both to benchmark forward paths with and without
+//TEDDIE -   --vsync N              swap interval: 0 off, 1 on (default), -1 adaptive
+//TEDDIE -   --fps-cap N            limit the frame rate to N frames per second (default 0, no limit)
+bool UParseOptions(int argc, char* argv[], RunOptions& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (strcmp(arg, "--headless") == 0)
+            options.headless = true;
+        else if (strcmp(arg, "--frames") == 0 && hasValue)
+            options.frames = atoi(argv[++i]);
+        else if (strcmp(arg, "--capture") == 0 && hasValue)
+            options.captureFrames.push_back(atoi(argv[++i]));
+        else if (strcmp(arg, "--capture-prefix") == 0 && hasValue)
+            options.capturePrefix = argv[++i];
+        else if (strcmp(arg, "--benchmark") == 0 && hasValue)
+            options.benchmark = argv[++i];
+        else if (strcmp(arg, "--bench-frames") == 0 && hasValue)
+            options.benchFrames = atoi(argv[++i]);
+        else if (strcmp(arg, "--bench-warmup") == 0 && hasValue)
+            options.benchWarmup = atoi(argv[++i]);
+        else if (strcmp(arg, "--bench-output") == 0 && hasValue)
+            options.benchOutput = argv[++i];
+        else if (strcmp(arg, "--baseline") == 0 && hasValue)
+            options.baseline = argv[++i];
+        else if (strcmp(arg, "--fail-avg") == 0 && hasValue)
+            options.thresholds.avgPercent = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--fail-p99") == 0 && hasValue)
+            options.thresholds.p99Percent = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--vram-budget") == 0 && hasValue)
+            options.vramBudget = (size_t)(atof(argv[++i]) * 1024.0 * 1024.0);
+        else if (strcmp(arg, "--lod-error") == 0 && hasValue)
+            options.lodError = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--no-lod") == 0)
+            options.lod = false;
+        else if (strcmp(arg, "--program-cache") == 0 && hasValue)
+            options.programCache = argv[++i];
+        else if (strcmp(arg, "--no-program-cache") == 0)
+            options.programCache.clear();
+        else if (strcmp(arg, "--renderer") == 0 && hasValue)
+            options.renderer = argv[++i];
+        else if (strcmp(arg, "--depth-prepass") == 0 && hasValue)
+            options.depthPrepass = argv[++i];
+        else if (strcmp(arg, "--vsync") == 0 && hasValue)
+            options.vsync = std::min(std::max(atoi(argv[++i]), -1), 1);
+        else if (strcmp(arg, "--fps-cap") == 0 && hasValue)
+            options.fpsCap = std::max((float)atof(argv[++i]), 0.0f);
+        else if (strcmp(arg, "--lights") == 0 && hasValue)
+            options.lights = std::max(atoi(argv[++i]), 0);
+        else if (strcmp(arg, "--bench-image") == 0 && hasValue)
+            options.benchImage = argv[++i];
+        else if (strcmp(arg, "--profile") == 0 && hasValue)
+            options.profilePrefix = argv[++i];
+        else if (strcmp(arg, "--textures") == 0 && hasValue)
+        {
+            options.textureDir = argv[++i];
+            if (!options.textureDir.empty() && options.textureDir.back() != '/' && options.textureDir.back() != '\\')
+                options.textureDir += '/';
+        }
+        else
+        {
+            cout << "Unknown or incomplete option " << arg << endl;
+            return false;
+        }
+    }
+
+    if (!options.captureFrames.empty() && !options.headless)
+        cout << "WARNING: --capture only applies to --headless runs" << endl;
+    if (options.renderer != "forward" && options.renderer != "deferred" && options.renderer != "both")
+    {
+        cout << "Unknown renderer " << options.renderer << " (forward, deferred or both)" << endl;
+        return false;
+    }
+    if (options.depthPrepass != "on" && options.depthPrepass != "off" && options.depthPrepass != "both")
+    {
+        cout << "Unknown depth pre-pass mode " << options.depthPrepass << " (on, off or both)" << endl;
+        return false;
+    }
+    return true;
+}
+
+
+//TEDDIE - no GLFW at all in headless mode: EGL context, GLEW, then an FBO the size of the window
+bool UInitializeHeadless()
+{
+    if (!gHeadlessContext.Create())
+        return false;
+
+    // glewInit would also look for GLX / WGL extensions, which need a display;
+    // glewContextInit only loads the core GL entry points and GL extensions
+    glewExperimental = GL_TRUE;
+    GLenum GlewInitResult = glewContextInit();
+    if (GLEW_OK != GlewInitResult)
+    {
+        std::cerr << glewGetErrorString(GlewInitResult) << std::endl;
+        return false;
+    }
+
+    cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl;
+    cout << "INFO: OpenGL Renderer: " << glGetString(GL_RENDERER) << endl;
+
+    return gOffscreen.Create(WINDOW_WIDTH, WINDOW_HEIGHT);
+}
+
+
+//TEDDIE - render gOptions.frames frames with a fixed 60 Hz timestep, saving the requested ones
+void URunHeadless()
+{
+    const float timestep = 1.0f / 60.0f;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < gOptions.frames; ++frame)
+    {
+        gDeltaTime = timestep;
+        gLastFrame += timestep;
+
+        gProfiler.BeginFrame();
+        gProfiler.Begin("frame");
+        URender();
+        gProfiler.End();
+        gProfiler.EndFrame();
+
+        for (size_t i = 0; i < gOptions.captureFrames.size(); ++i)
+        {
+            if (gOptions.captureFrames[i] == frame)
+                UCaptureFrame(frame);
+        }
+    }
+    glFinish();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    const RenderStats& stats = gRenderQueue.Stats();
+    cout << "INFO: Headless: " << gOptions.frames << " frames in " << elapsed.count() << " ms ("
+        << (gOptions.frames > 0 ? elapsed.count() / gOptions.frames : 0.0) << " ms/frame), "
+        << stats.instances << " objects in " << stats.draws << " draws" << endl;
+}
+
+
+//TEDDIE - the camera paths the benchmark can replay, all looping and in scene units
+std::vector<CameraPath> UCreateBenchmarkPaths()
+{
+    std::vector<CameraPath> paths;
+    const glm::vec3 table(-0.3f, -0.3f, -0.2f);
+
+    //TEDDIE - orbit: once around the table, 12 s per lap
+    CameraPath orbit("orbit");
+    for (int i = 0; i <= 48; ++i)
+    {
+        float angle = glm::radians(360.0f * i / 48.0f);
+        glm::vec3 position = table + glm::vec3(4.0f * cosf(angle), 1.5f, 4.0f * sinf(angle));
+        orbit.AddLookAt(12.0f * i / 48.0f, position, table);
+    }
+    paths.push_back(orbit);
+
+    //TEDDIE - topdown: the P key view, held still, then eased back to the start view (O key)
+    CameraPath topdown("topdown");
+    topdown.AddKey(0.0f, glm::vec3(-3.0f, 5.0f, -2.0f), -90.0f, -100.0f);
+    topdown.AddKey(6.0f, glm::vec3(-3.0f, 5.0f, -2.0f), -90.0f, -100.0f);
+    topdown.AddKey(8.0f, glm::vec3(0.0f, 0.0f, 10.0f), -90.0f, 0.0f);
+    topdown.AddKey(10.0f, glm::vec3(-3.0f, 5.0f, -2.0f), -90.0f, -100.0f);
+    paths.push_back(topdown);
+
+    //TEDDIE - coasters: low, close sweeps across the coaster stacks and back
+    const glm::vec3 coasters(-0.9f, -0.45f, -0.27f);
+    CameraPath passes("coasters");
+    passes.AddLookAt(0.0f, coasters + glm::vec3(-1.2f, 0.35f, 0.9f), coasters);
+    passes.AddLookAt(2.5f, coasters + glm::vec3(0.0f, 0.2f, 0.6f), coasters);
+    passes.AddLookAt(5.0f, coasters + glm::vec3(1.2f, 0.35f, 0.3f), coasters);
+    passes.AddLookAt(7.5f, coasters + glm::vec3(0.3f, 0.12f, -0.7f), coasters);
+    passes.AddLookAt(10.0f, coasters + glm::vec3(-1.2f, 0.35f, 0.9f), coasters);
+    paths.push_back(passes);
+
+    return paths;
+}
+
+
+//TEDDIE - replays the chosen paths with a fixed timestep, no input and no vsync
+//TEDDIE - CPU time per frame is measured here, GPU time comes from the profiler
+bool URunBenchmark()
+{
+    const float timestep = 1.0f / 60.0f;
+
+    std::vector<CameraPath> paths = UCreateBenchmarkPaths();
+    std::vector<CameraPath> selected;
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        if (gOptions.benchmark == "all" || gOptions.benchmark == paths[i].Name())
+            selected.push_back(paths[i]);
+    }
+    if (selected.empty())
+    {
+        cout << "Unknown benchmark path " << gOptions.benchmark << " (orbit, topdown, coasters or all)" << endl;
+        return false;
+    }
+
+    // frames are not capped at the refresh rate
+    gPacer.SetSwapInterval(0);
+    gPacer.SetTargetFps(0.0f);
+
+    //TEDDIE - forward results keep the plain path name so older baselines still line up
+    struct BenchMode
+    {
+        bool deferred;
+        bool prepass;
+        const char* suffix;
+    };
+    std::vector<BenchMode> modes;
+    if (gOptions.renderer != "deferred" && gOptions.depthPrepass != "on")
+        modes.push_back({ false, false, "" });
+    if (gOptions.renderer != "deferred" && gOptions.depthPrepass != "off")
+        modes.push_back({ false, true, "-prepass" });
+    if (gOptions.renderer != "forward")
+        modes.push_back({ true, false, "-deferred" });
+
+    BenchmarkReport report((const char*)glGetString(GL_RENDERER), timestep, gOptions.benchFrames, gOptions.benchWarmup);
+    for (size_t run = 0; run < selected.size() * modes.size(); ++run)
+    {
+        const CameraPath& path = selected[run / modes.size()];
+        const BenchMode& mode = modes[run % modes.size()];
+        gDeferred = mode.deferred;
+        gDepthPrepass = mode.prepass;
+        std::vector<float> cpuMs;
+        long long culledTotal = 0;
+        int shadowRebuildsBefore = gShadowMap.Rebuilds();
+        cpuMs.reserve(gOptions.benchFrames);
+
+        for (int frame = -gOptions.benchWarmup; frame < gOptions.benchFrames; ++frame)
+        {
+            //TEDDIE - warmup frames sit at the path's first key so caches are primed for frame 0
+            if (frame == 0)
+            {
+                gProfiler.Flush();
+                gProfiler.Reset();
+                gFragments.Flush();
+                gFragments.Reset();
+                shadowRebuildsBefore = gShadowMap.Rebuilds();
+            }
+
+            CameraKey key = path.Sample(std::max(frame, 0) * timestep);
+            gCamera.Position = key.position;
+            gCamera.Yaw = key.yaw;
+            gCamera.Pitch = key.pitch;
+            gCamera.ProcessMouseMovement(0.0f, 0.0f, false);    // rebuilds the camera vectors
+            gDeltaTime = timestep;
+            gLastFrame += timestep;
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            gProfiler.BeginFrame();
+            gProfiler.Begin("frame");
+            URender();
+            gProfiler.End();
+            gProfiler.EndFrame();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+            if (frame >= 0)
+            {
+                cpuMs.push_back((float)elapsed.count());
+                culledTotal += gCuller.Stats().culled;
+            }
+            if (gWindow)
+                glfwPollEvents();
+        }
+        gProfiler.Flush();
+        gFragments.Flush();
+
+        BenchmarkResult result;
+        result.path = path.Name() + mode.suffix;
+        result.cpu = FrameTimeStats::From(cpuMs);
+        FrameProfiler::Summary gpu = gProfiler.Gpu("frame");
+        result.gpuAvg = gpu.avg;
+        result.gpuP95 = gpu.p95;
+        result.gpuP99 = gpu.p99;
+        result.draws = gRenderQueue.Stats().draws;
+        result.instances = gRenderQueue.Stats().instances;
+        result.culledAvg = cpuMs.empty() ? 0.0f : (float)culledTotal / cpuMs.size();
+        result.lights = gLightClusters.Stats().lights;
+        result.lightAssignAvg = gProfiler.Cpu("light assignment").avg;
+        result.shadowRebuilds = gShadowMap.Rebuilds() - shadowRebuildsBefore;
+        result.fragmentsAvg = gFragments.Average();
+        report.Add(result);
+
+        char line[256];
+        snprintf(line, sizeof(line), "INFO: Benchmark %-10s cpu avg %.3f p99 %.3f ms | gpu avg %.3f p99 %.3f ms | %.1f culled | %d lights, assign %.3f ms | %d shadow rebuilds | %.2fM fragments",
+            result.path.c_str(), result.cpu.avg, result.cpu.p99, result.gpuAvg, result.gpuP99, result.culledAvg,
+            result.lights, result.lightAssignAvg, result.shadowRebuilds, result.fragmentsAvg / 1.0e6);
+        cout << line << endl;
+    }
+
+    report.WriteJson(gOptions.benchOutput);
+    if (gOptions.baseline.empty())
+        return true;
+    return report.CompareToBaseline(gOptions.baseline, gOptions.thresholds);
+}
+
+
+//TEDDIE - best of 5 runs, in ms
+double UTimeKernel(const std::function<void()>& kernel)
+{
+    double best = 1e30;
+    for (int run = 0; run < 5; ++run)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        kernel();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+
+//TEDDIE - one table row: scalar reference, SIMD on one thread, SIMD across rows (0 = not threaded)
+void UReportKernel(const char* name, double scalarMs, double simdMs, double threadedMs, bool matches)
+{
+    char line[256];
+    if (threadedMs > 0.0)
+        snprintf(line, sizeof(line), "  %-22s scalar %8.3f ms | simd %8.3f ms (%5.1fx) | threaded %8.3f ms (%5.1fx) %s",
+            name, scalarMs, simdMs, scalarMs / simdMs, threadedMs, scalarMs / threadedMs, matches ? "" : "MISMATCH");
+    else
+        snprintf(line, sizeof(line), "  %-22s scalar %8.3f ms | simd %8.3f ms (%5.1fx) %s",
+            name, scalarMs, simdMs, scalarMs / simdMs, matches ? "" : "MISMATCH");
+    cout << line << endl;
+}
+
+
+//TEDDIE - times every image_ops kernel on a real photo against the per-pixel reference code
+//TEDDIE - (flip is the old flipImageVertically loop) and checks the outputs are identical
+bool UBenchmarkImageOps(const std::string& filename)
+{
+    int width = 0, height = 0, channels = 0;
+    unsigned char* decoded = stbi_load(filename.c_str(), &width, &height, &channels, 0);
+    if (!decoded)
+    {
+        cout << "Failed to load " << filename << endl;
+        return false;
+    }
+    const std::vector<uint8_t> source(decoded, decoded + (size_t)width * height * channels);
+    stbi_image_free(decoded);
+
+    const size_t pixels = (size_t)width * height;
+    const int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    cout << "INFO: " << filename << " " << width << "x" << height << ", " << channels << " channels, "
+        << threads << " threads" << endl;
+
+    bool allMatch = true;
+    std::vector<uint8_t> a, b, c;
+
+    // flip in place, source channel count
+    a = b = c = source;
+    double scalar = UTimeKernel([&] { image_ops::reference::FlipRows(a.data(), width, height, channels); });
+    double simd = UTimeKernel([&] { image_ops::FlipRows(b.data(), width, height, channels, 1); });
+    double threaded = UTimeKernel([&] { image_ops::FlipRows(c.data(), width, height, channels, threads); });
+    // five flips each: all end up flipped once
+    bool matches = a == b && a == c;
+    allMatch &= matches;
+    UReportKernel("flip rows", scalar, simd, threaded, matches);
+
+    // expand the source to RGBA8
+    a.assign(pixels * 4, 0);
+    b.assign(pixels * 4, 0);
+    scalar = UTimeKernel([&] { image_ops::reference::ExpandToRGBA(source.data(), a.data(), pixels, channels); });
+    simd = UTimeKernel([&] { image_ops::ExpandToRGBA(source.data(), b.data(), pixels, channels); });
+    matches = a == b;
+    allMatch &= matches;
+    UReportKernel(channels == 3 ? "rgb -> rgba" : "expand -> rgba", scalar, simd, 0.0, matches);
+
+    // what the texture loader does: flip + expand, fused and threaded vs the two scalar passes
+    std::vector<uint8_t> flipped;
+    scalar = UTimeKernel([&]
+    {
+        flipped = source;
+        image_ops::reference::FlipRows(flipped.data(), width, height, channels);
+        image_ops::reference::ExpandToRGBA(flipped.data(), a.data(), pixels, channels);
+    });
+    simd = UTimeKernel([&] { b = image_ops::ToRGBA(source.data(), width, height, channels, 1); });
+    threaded = UTimeKernel([&] { c = image_ops::ToRGBA(source.data(), width, height, channels, threads); });
+    matches = a == b && a == c;
+    allMatch &= matches;
+    UReportKernel("flip + expand (loader)", scalar, simd, threaded, matches);
+
+    // grey and grey + alpha expansion, built from the first channel
+    std::vector<uint8_t> grey(pixels), greyAlpha(pixels * 2);
+    for (size_t i = 0; i < pixels; ++i)
+    {
+        grey[i] = source[i * channels];
+        greyAlpha[i * 2] = grey[i];
+        greyAlpha[i * 2 + 1] = (uint8_t)(255 - grey[i]);
+    }
+    scalar = UTimeKernel([&] { image_ops::reference::ExpandToRGBA(grey.data(), a.data(), pixels, 1); });
+    simd = UTimeKernel([&] { image_ops::ExpandToRGBA(grey.data(), b.data(), pixels, 1); });
+    matches = std::equal(a.begin(), a.begin() + pixels * 4, b.begin());
+    allMatch &= matches;
+    UReportKernel("grey -> rgba", scalar, simd, 0.0, matches);
+
+    scalar = UTimeKernel([&] { image_ops::reference::ExpandToRGBA(greyAlpha.data(), a.data(), pixels, 2); });
+    simd = UTimeKernel([&] { image_ops::ExpandToRGBA(greyAlpha.data(), b.data(), pixels, 2); });
+    matches = std::equal(a.begin(), a.begin() + pixels * 4, b.begin());
+    allMatch &= matches;
+    UReportKernel("grey+alpha -> rgba", scalar, simd, 0.0, matches);
+
+    // premultiply an RGBA copy (fresh copy per run so every run does the same work)
+    std::vector<uint8_t> rgba = image_ops::ToRGBA(greyAlpha.data(), width, height, 2);
+    scalar = UTimeKernel([&] { a = rgba; image_ops::reference::PremultiplyAlpha(a.data(), pixels); });
+    simd = UTimeKernel([&] { b = rgba; image_ops::PremultiplyAlpha(b.data(), pixels); });
+    matches = a == b;
+    allMatch &= matches;
+    UReportKernel("premultiply (+copy)", scalar, simd, 0.0, matches);
+
+    // first mip level
+    const size_t mipBytes = (size_t)std::max(1, width / 2) * std::max(1, height / 2) * 4;
+    a.assign(mipBytes, 0);
+    b.assign(mipBytes, 0);
+    c.assign(mipBytes, 0);
+    scalar = UTimeKernel([&] { image_ops::reference::Downsample(rgba.data(), width, height, a.data()); });
+    simd = UTimeKernel([&] { image_ops::Downsample(rgba.data(), width, height, b.data(), 1); });
+    threaded = UTimeKernel([&] { image_ops::Downsample(rgba.data(), width, height, c.data(), threads); });
+    matches = a == b && a == c;
+    allMatch &= matches;
+    UReportKernel("2x2 mip", scalar, simd, threaded, matches);
+
+    cout << (allMatch ? "INFO: All kernels match the scalar reference" : "WARNING: Kernel output differs from the scalar reference") << endl;
+    return allMatch;
+}
+
+
+//TEDDIE - rolling min / avg / p95 / p99 per frame stage, CPU and GPU side by side
+void UWriteProfile()
+{
+    gProfiler.WriteCsv(gOptions.profilePrefix + ".csv");
+    gProfiler.WriteJson(gOptions.profilePrefix + ".json");
+}
+
+
+//TEDDIE - live GL objects and bytes per category (buffers, textures, ...) plus the peak
+void UReportGpuResources()
+{
+    GpuResources().Report();
+}
+
+
+//TEDDIE - read the FBO back and write it as <prefix>_<frame>.png
+void UCaptureFrame(int frame)
+{
+    std::vector<unsigned char> pixels;
+    gOffscreen.ReadPixels(pixels);
+
+    char filename[512];
+    snprintf(filename, sizeof(filename), "%s_%04d.png", gOptions.capturePrefix.c_str(), frame);
+
+    // GL rows start at the bottom, PNG rows at the top
+    stbi_flip_vertically_on_write(1);
+    if (stbi_write_png(filename, gOffscreen.Width(), gOffscreen.Height(), 4, pixels.data(), gOffscreen.Width() * 4))
+        cout << "INFO: Captured frame " << frame << " to " << filename << endl;
+    else
+        cout << "WARNING: Failed to write " << filename << endl;
+}
+
 //TEDDIE _ DO NOT TOUCH!!!!!!!!!!!!!!!!!
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 void UProcessInput(GLFWwindow* window)
@@ -517,8 +1460,6 @@ void UProcessInput(GLFWwindow* window)
 
         gCamera.Position = glm::vec3(-3.0f, 5.0f, -2.0f);
         gCamera.Pitch = -100.0f;
-        glfwSwapBuffers(window);
-        glfwPollEvents();
 
     }
 
@@ -527,11 +1468,53 @@ void UProcessInput(GLFWwindow* window)
 
         gCamera.Position = glm::vec3(0.0f, 0.0f, 10.0f);
         gCamera.Pitch = 0.0f;
-        glfwSwapBuffers(window);
-        glfwPollEvents();
 
     }
 
+    //TEDDIE - use F9 to dump the profiler, once per press
+    static bool profileKeyDown = false;
+    bool profileKey = glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS;
+    if (profileKey && !profileKeyDown)
+        UWriteProfile();
+    profileKeyDown = profileKey;
+
+    //TEDDIE - use G to switch between forward and deferred shading, once per press
+    static bool rendererKeyDown = false;
+    bool rendererKey = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+    if (rendererKey && !rendererKeyDown)
+    {
+        gDeferred = !gDeferred;
+        cout << "INFO: " << (gDeferred ? "Deferred" : "Forward") << " shading" << endl;
+    }
+    rendererKeyDown = rendererKey;
+
+    //TEDDIE - use Z to switch the depth pre-pass (forward shading only), once per press
+    static bool prepassKeyDown = false;
+    bool prepassKey = glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS;
+    if (prepassKey && !prepassKeyDown)
+    {
+        gDepthPrepass = !gDepthPrepass;
+        cout << "INFO: Depth pre-pass " << (gDepthPrepass ? "on" : "off") << endl;
+    }
+    prepassKeyDown = prepassKey;
+
+    //TEDDIE - use V to switch vsync on / off, once per press
+    static bool vsyncKeyDown = false;
+    bool vsyncKey = glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS;
+    if (vsyncKey && !vsyncKeyDown)
+    {
+        gPacer.SetSwapInterval(gPacer.SwapInterval() == 0 ? 1 : 0);
+        cout << "INFO: Vsync " << (gPacer.SwapInterval() ? "on" : "off") << endl;
+    }
+    vsyncKeyDown = vsyncKey;
+
+    //TEDDIE - use F10 to print GPU memory per resource type, once per press
+    static bool resourceKeyDown = false;
+    bool resourceKey = glfwGetKey(window, GLFW_KEY_F10) == GLFW_PRESS;
+    if (resourceKey && !resourceKeyDown)
+        UReportGpuResources();
+    resourceKeyDown = resourceKey;
+
     //TEDDIE - use esc to exit
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
@@ -563,6 +1546,7 @@ void UProcessInput(GLFWwindow* window)
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    gViewportSize = glm::ivec2(width, height);
 }
 
 
@@ -638,15 +1622,21 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 // Functioned called to render a frame
 void URender()
 {
+    gProfiler.Begin("render");
+
+    //TEDDIE - move finished texture decodes onto the GPU, a bounded amount per frame
+    gProfiler.Begin("texture uploads");
+    gTextures.Update();
+    gProfiler.End();
+
     // Enable z-depth
     glEnable(GL_DEPTH_TEST);
 
     // Clear the frame and z buffers
+    gProfiler.Begin("clear");
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    //TEDDIE - set shader to use
-    glUseProgram(gProgramId);
+    gProfiler.End();
 
     // camera/view transformation
     glm::mat4 view = gCamera.GetViewMatrix();
@@ -662,318 +1652,264 @@ void URender()
     }
 
 
-    //TEDDIE - CONES FOR DRINK AND LIGHTING
-    //TEDIE _ DO NOT TOUCH THIS CONE!!!
-    float spike = 0.25f;
-    glm::mat4 scale = glm::scale(glm::vec3(spike, 0.9f, spike));
-    glm::mat4 rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
-    glm::mat4 translation = glm::translate(glm::vec3(-0.545f, -0.5f, 0.0f));
-    glm::mat4 model = translation * rotation * scale;
-
-    // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Reference matrix uniforms from the Cube Shader program for the cub color, light color, light position, and camera position
-    GLint objectColorLoc = glGetUniformLocation(gProgramId, "objectColor");
-    GLint lightColorLoc = glGetUniformLocation(gProgramId, "lightColor");
-    GLint keyLightColorLoc = glGetUniformLocation(gProgramId, "keyLightColor");
-    GLint lightPositionLoc = glGetUniformLocation(gProgramId, "lightPos");
-    GLint viewPositionLoc = glGetUniformLocation(gProgramId, "viewPosition");
-
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(lightColorLoc, gLightColor.r, gLightColor.g, gLightColor.b);
-    glUniform3f(lightPositionLoc, gLightPosition.x, gLightPosition.y, gLightPosition.z);
+    //TEDDIE - only recompute world matrices for objects that changed
+    gProfiler.Begin("scene update");
+    if (gScene.Node(gLampNode).position != gLightPosition)
+        gScene.SetPosition(gLampNode, gLightPosition);
+    gScene.Update();
+    gProfiler.End();
+
+    //TEDDIE - every light against the clusters it can reach, only the key light ever moves
+    gProfiler.Begin("light assignment");
+    gLights[0].positionRadius = glm::vec4(gLightPosition, 0.0f);
+    gLightClusters.Assign(gLights, view, projection);
+    gProfiler.End();
+
+    //TEDDIE - the shadow map is aimed before the frame uniforms carry its matrix, drawn after
+    const bool shadowStale = gShadowMap.Stale(gLightPosition, gScene.CasterVersion());
+    if (shadowStale)
+        UAimShadowMap();
+
+    //TEDDIE - camera and lights go to the GPU once, every program reads the same buffer
+    gProfiler.Begin("frame uniforms");
+    UUpdateFrameUniforms(view, projection);
+    gProfiler.End();
+
+    //TEDDIE - its own scope so the profile's sample count is the number of rebuilds
+    if (shadowStale)
+    {
+        gProfiler.Begin("shadow rebuild");
+        URenderShadowMap();
+        gProfiler.End();
+    }
+    gShadowMap.Bind();
+
+    //TEDDIE - world bounds of every object against the six frustum planes, four at a time
+    gProfiler.Begin("culling");
+    const std::vector<SceneNode>& nodes = gScene.Nodes();
+    gCuller.Begin(projection * view);
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (nodes[i].mesh != INVALID_MESH)
+            gCuller.Add(gMeshes.Bounds(nodes[i].mesh), nodes[i].world);
+    }
+    gCuller.Cull();
+    gProfiler.End();
+
+    //TEDDIE - queue every visible object, sort by program / mesh / distance and submit
+    //TEDDIE - so state only changes when it has to
+    gProfiler.Begin("queue build");
     const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-    GLint UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao[0]);
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, drinkTex);
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[0]);
-
-
-    //TEDDIE - Cone 2
-    //TEDDIE - DO NOT TOUCH THIS IT IS IN PLACE
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, drinkTex);
-    scale = glm::scale(glm::vec3(spike, 0.6f, spike));
-    rotation = glm::rotate(3.1415f, glm::vec3(1.0f, 0.0f, 0.0f));
-    translation = glm::translate(glm::vec3(-0.545f, 0.3f, 0.0f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao[1]);
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[1]);
+    gRenderQueue.Clear();
+    //TEDDIE - nearest first across everything while the pre-pass is on, so it rejects the most
+    gRenderQueue.SetFrontToBack(gDepthPrepass && !gDeferred);
+    gLod.Begin(view, projection, gViewportSize.y);
+    int cullIndex = 0;
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        const SceneNode& node = nodes[i];
+        if (node.mesh == INVALID_MESH)
+            continue;
+        //TEDDIE - same order as the Add() calls above
+        if (!gCuller.Visible(cullIndex++))
+            continue;
+
+        //TEDDIE - small on screen = fewer sectors, the level sticks until the size clearly changes
+        MeshHandle mesh = node.mesh;
+        if (node.lod.count > 1)
+        {
+            float diameter = gLod.ProjectedDiameter(gMeshes.Bounds(node.mesh), node.world);
+            mesh = node.lod.levels[gLod.Select((int)i, node.lod, diameter)];
+        }
 
+        //TEDDIE - deferred: lit objects only fill the G-buffer, the lamp markers stay forward
+        const ShaderProgram* program = gDeferred && node.program == &gProgram ? &gGBufferProgram : node.program;
 
-    //TEDDIE - PLANE
-    //TEDDIE _ IN POSITION DO NOT TOUCH
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, planeTex);
-    scale = glm::scale(glm::vec3(2.0f, 1.0f, 1.5f));
-    translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-    model = translation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao[2]);
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[2]);
-
-    //TEDDIE - ceramic FOR coasters
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, corkTex);
-    glBindVertexArray(gMesh.vao[3]);
-    //TEDDIE - DONT CHANGE THIS IS IN POSITION!!!!!!
-    scale = glm::scale(glm::vec3(0.26f, 0.005f, 0.26f));
-    rotation = glm::rotate(45.0f, glm::vec3(0.0, 1.0f, 0.0f));
-    translation = glm::translate(glm::vec3(-0.76f, -0.425f, -0.32f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    static_meshes_3D::Cylinder C1(1, 30, 3, true, true, true);
-    C1.render();
-
-    //TEDDIE - ceramic FOR coasters
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, corkTex);
-    glBindVertexArray(gMesh.vao[4]);
-    //TEDDIE - DONT CHANGE THIS IS IN POSITION!!!!!!
-    scale = glm::scale(glm::vec3(0.26f, 0.005f, 0.26f));
-    rotation = glm::rotate(45.0f, glm::vec3(0.0, 1.0f, 0.0f));
-    translation = glm::translate(glm::vec3(-0.90f, -0.445f, -0.33f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    static_meshes_3D::Cylinder C2(1, 30, 3, true, true, true);
-    C2.render();
-
-    //TEDDIE - cork for coasters
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, corkTex);
-    glBindVertexArray(gMesh.vao[5]);
-    //TEDDIE - DONT CHANGE THIS IS IN POSITION!!!!!!
-    scale = glm::scale(glm::vec3(0.26f, 0.005f, 0.26f));
-    rotation = glm::rotate(45.0f, glm::vec3(0.0, 1.0f, 0.0f));
-    translation = glm::translate(glm::vec3(-0.98f, -0.465f, -0.26f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    static_meshes_3D::Cylinder C3(1, 30, 3, true, true, true);
-    C3.render();
-
-    //TEDDIE - cork for coasters
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, corkTex);
-    glBindVertexArray(gMesh.vao[6]);
-    //TEDDIE - DONT CHANGE THIS IS IN POSITION!!!!!!
-    scale = glm::scale(glm::vec3(0.26f, 0.005f, 0.26f));
-    rotation = glm::rotate(45.0f, glm::vec3(0.0, 1.0f, 0.0f));
-    translation = glm::translate(glm::vec3(-0.98f, -0.485f, -0.18f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    static_meshes_3D::Coaster C4(1, 30, 3, true, true, true);
-    C4.render();
-
-    //TEDDIE - ceramic for coasters
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, ceramicTex);
-    glBindVertexArray(gMesh.vao[7]);
-    //TEDDIE - DONT CHANGE THIS IS IN POSITION!!!!!!
-    scale = glm::scale(glm::vec3(0.27f, 0.005f, 0.27f));
-    rotation = glm::rotate(45.0f, glm::vec3(0.0, 1.0f, 0.0f));
-    translation = glm::translate(glm::vec3(-0.76f, -0.43f, -0.32f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    static_meshes_3D::Coaster C5(1, 30, 3, true, true, true);
-    C5.render();
-
-    //TEDDIE - ceramic for coasters
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, ceramicTex);
-    glBindVertexArray(gMesh.vao[8]);
-    //TEDDIE - DONT CHANGE THIS IS IN POSITION!!!!!!
-    scale = glm::scale(glm::vec3(0.27f, 0.005f, 0.27f));
-    rotation = glm::rotate(45.0f, glm::vec3(0.0, 1.0f, 0.0f));
-    translation = glm::translate(glm::vec3(-0.90f, -0.45f, -0.33f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    static_meshes_3D::Coaster C6(1, 30, 3, true, true, true);
-    C6.render();
-
-    //TEDDIE - ceramic for coasters
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, ceramicTex);
-    glBindVertexArray(gMesh.vao[9]);
-    //TEDDIE - DONT CHANGE THIS IS IN POSITION!!!!!!
-    scale = glm::scale(glm::vec3(0.27f, 0.005f, 0.27f));
-    rotation = glm::rotate(45.0f, glm::vec3(0.0, 1.0f, 0.0f));
-    translation = glm::translate(glm::vec3(-0.98f, -0.47f, -0.26f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    static_meshes_3D::Coaster C7(1, 30, 3, true, true, true);
-    C7.render();
-
-    //TEDDIE - ceramic for coasters
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, ceramicTex);
-    glBindVertexArray(gMesh.vao[10]);
-    //TEDDIE - DONT CHANGE THIS IS IN POSITION!!!!!!
-    scale = glm::scale(glm::vec3(0.27f, 0.005f, 0.27f));
-    rotation = glm::rotate(45.0f, glm::vec3(0.0, 1.0f, 0.0f));
-    translation = glm::translate(glm::vec3(-0.98f, -0.49f, -0.18f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    static_meshes_3D::Coaster C8(1, 30, 3, true, true, true);
-    C8.render();
+        float depth = glm::length(glm::vec3(node.world[3]) - cameraPosition);
+        const MaterialSlot* material = node.material == NO_MATERIAL ? nullptr : &gMaterials.Get(node.material);
+        gRenderQueue.Submit(program, material, mesh, node.world, node.normalMatrix, depth);
+    }
+    gRenderQueue.Sort();
+    gProfiler.End();
 
+    //TEDDIE - fragment invocations count the shading passes only (URenderDepthPrepass skips its depth pass)
+    gProfiler.Begin("queue flush");
+    if (gDeferred)
+    {
+        gFragments.Begin();
+        URenderDeferred(projection * view);
+        gFragments.End();
+    }
+    else if (gDepthPrepass)
+        URenderDepthPrepass();
+    else
+    {
+        gFragments.Begin();
+        gRenderQueue.Flush(gMeshes, gMaterials);
+        gFragments.End();
+    }
+    gProfiler.End();
 
+    // Deactivate the Vertex Array Object and shader program
+    glBindVertexArray(0);
 
-    //TEDDIE - INSIDE LIME
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, limeTex);
-    scale = glm::scale(glm::vec3(0.5f, 0.5f, 0.5f));
-    translation = glm::translate(glm::vec3(-1.0f, 1.5f, -0.6f));
-    model = translation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    //Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao[11]);
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[11]);
+    gProfiler.End();
 
-    //TEDDIE - MORBID BOX
-    //TEDDIE - COMPLETED DO NOT TOUCH AGAIN
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, morbidTex);
-    scale = glm::scale(glm::vec3(0.5f, 0.35f, 0.35f));
-    rotation = glm::rotate(15.0f, glm::vec3(0.0, 0.27f, 0.0f));
-    translation = glm::translate(glm::vec3(0.7f, -0.3f, -0.4f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    //Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao[12]);
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[12]);
-
-    //TEDDIE - DOME THING RIND
-    //TEDDIE - COMPLETED DO NOT TOUCH AGAIN
-    //glActiveTexture(GL_TEXTURE0);
-    //glBindTexture(GL_TEXTURE_2D, rindTex);
-    //scale = glm::scale(glm::vec3(0.23f, 0.16f, 0.16f));
-    //rotation = glm::rotate(15.0f, glm::vec3(1.5, 0.0f, 1.0f));
-    //translation = glm::translate(glm::vec3(1.0f, -0.45f, -0.45f));
-    //model = translation * rotation * scale;
-    //modelLoc = glGetUniformLocation(gProgramId, "model");
-    //glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    //Activate the VBOs contained within the mesh's VAO
-    //glBindVertexArray(gMesh.vao[13]);
-    // Draws the triangles
-    //glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[13]);
+    if (!gFirstFrameDone)
+        UReportFirstFrame();
 
-    //TEDDIE - DOME THING 2
-//TEDDIE - COMPLETED DO NOT TOUCH AGAIN
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, limeTex);
-    scale = glm::scale(glm::vec3(0.22f, 0.15f, 0.15f));
-    rotation = glm::rotate(90.0f, glm::vec3(1.5f, -0.4f, 0.5f));
-    translation = glm::translate(glm::vec3(0.0f, -0.45f, -0.45f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    //Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao[14]);
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[14]);
 
-    
+    //TEDDIE - the pacer waits out the frame cap, then flips the back buffer with the front buffer
+    //TEDDIE - (headless frames stay in the FBO, nothing to swap)
+    gProfiler.Begin("swap");
+    gPacer.Present();
+    gProfiler.End();
 
-    //TEDDIE - LIME RIND
-    Sphere sphere(1.0f, 72, 24, false);
-    sphere.setRadius(2.0f);
-    sphere.setSectorCount(72);
-    sphere.setStackCount(24);
-    sphere.setSmooth(false);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, sphereTex);
-    sphere.draw();
 
-    
+}
 
-    //TEDDIE - SPHERE FOR ON DRINK THING
-    //TEDDIE - DONT CHANGE THIS IS IN POSITION!!!!!!
-    Sphere2 orb(0.4f, 30, 10);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, sphereTex);
-    scale = glm::scale(glm::vec3(0.35f, 0.35f, 0.35f));
-    rotation = glm::rotate(45.0f, glm::vec3(-0.85f, -0.7f, 0.1f));
-    translation = glm::translate(glm::vec3(-0.545f, 0.38f, 0.0f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    orb.Draw();
 
-    //TEDDIE - LIME RIND
-    //TEDDIE - COME BACK TO THIS
-    Sphere lime2(0.3f, 30, 10);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, rindTex);
-    //TEDDIE - DONT CHANGE THIS IS IN POSITION!!!!!!
-    scale = glm::scale(glm::vec3(0.45f, 0.45f, 0.45f));
-    rotation = glm::rotate(45.0f, glm::vec3(-1.85f, -0.7f, 0.1f));
-    translation = glm::translate(glm::vec3(0.0f, -0.4f, -0.5f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    lime2.draw();
-
-
-
-    //TEDDIE - SET UP THE LAMP PROGRAM
-    glUseProgram(gLightId);
-
-    //Transform the cone used as a visual que for the light source
-    model = glm::translate(gLightPosition) * glm::scale(gLightScale);
-
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLightId, "model");
-    viewLoc = glGetUniformLocation(gLightId, "view");
-    projLoc = glGetUniformLocation(gLightId, "projection");
-
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-    glBindVertexArray(gMesh.vao[0]);
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[0]);
+//TEDDIE - deferred path for the queue URender just built: lit objects write albedo / normal /
+//TEDDIE - depth, one full-screen pass shades every covered pixel exactly once, then the
+//TEDDIE - unlit lamp markers draw forward on top against the restored depth
+void URenderDeferred(const glm::mat4& viewProjection)
+{
+    if (!gGBuffer.Ensure(gViewportSize.x, gViewportSize.y))
+    {
+        gDeferred = false;
+        gRenderQueue.Flush(gMeshes, gMaterials);
+        return;
+    }
 
-    // Deactivate the Vertex Array Object and shader program
-    glBindVertexArray(0);
+    //TEDDIE - the window or the headless FBO, whichever the frame goes to
+    GLint target = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+
+    gRenderQueue.Prepare(gMeshes);
+
+    gProfiler.Begin("gbuffer");
+    gGBuffer.BeginGeometry();
+    gRenderQueue.Draw(gMeshes, gMaterials, &gGBufferProgram);
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)target);
+    gProfiler.End();
+
+    //TEDDIE - depth test always passes but still writes, so the markers are hidden correctly
+    gProfiler.Begin("lighting");
+    glUseProgram(gDeferredProgram.Id());
+    gDeferredProgram.Set(gDeferredLoc.uInverseViewProjection, glm::inverse(viewProjection));
+    gGBuffer.BindTextures();
+    glDepthFunc(GL_ALWAYS);
+    gGBuffer.DrawFullscreen();
+    glDepthFunc(GL_LESS);
+    gProfiler.End();
+
+    gProfiler.Begin("forward");
+    gRenderQueue.Draw(gMeshes, gMaterials, nullptr, &gGBufferProgram);
+    gProfiler.End();
+}
 
 
-    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+//TEDDIE - forward path in two passes over the queue URender just built: depth only with colour
+//TEDDIE - writes off, then the real programs with GL_EQUAL so only the nearest surface of each
+//TEDDIE - pixel runs the Phong shader. The shading pass has nothing left to write to depth
+void URenderDepthPrepass()
+{
+    gRenderQueue.Prepare(gMeshes);
+
+    gProfiler.Begin("depth prepass");
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glUseProgram(gDepthProgram.Id());
+    gRenderQueue.DrawAll(gMeshes);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    gProfiler.End();
+
+    //TEDDIE - only this pass is counted, so the number compares with the plain forward path
+    gProfiler.Begin("shading");
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+    gFragments.Begin();
+    gRenderQueue.Draw(gMeshes, gMaterials);
+    gFragments.End();
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+    gProfiler.End();
+}
+
+
+//TEDDIE - point the key light's shadow map at the sphere around every shadow caster
+void UAimShadowMap()
+{
+    const std::vector<SceneNode>& nodes = gScene.Nodes();
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (!nodes[i].castsShadow || nodes[i].mesh == INVALID_MESH)
+            continue;
+        const MeshBounds& bounds = gMeshes.Bounds(nodes[i].mesh);
+        const glm::mat4& world = nodes[i].world;
+        const glm::vec3 center = glm::vec3(world * glm::vec4(bounds.center, 1.0f));
+        const float scale = std::max(glm::length(glm::vec3(world[0])),
+            std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+        lo = glm::min(lo, center - glm::vec3(bounds.radius * scale));
+        hi = glm::max(hi, center + glm::vec3(bounds.radius * scale));
+    }
+    if (lo.x > hi.x)
+        lo = hi = glm::vec3(0.0f);
+
+    gShadowMap.Aim(gLightPosition, gScene.CasterVersion(), (lo + hi) * 0.5f, std::max(glm::length(hi - lo) * 0.5f, 0.01f));
+}
+
+
+//TEDDIE - every shadow caster's depth from the key light, through the render queue before URender
+//TEDDIE - builds the frame's real queue. Casters use their coarsest LOD level: it sits just inside
+//TEDDIE - the finer ones, so whatever level is on screen never falls behind its own shadow
+void URenderShadowMap()
+{
+    const std::vector<SceneNode>& nodes = gScene.Nodes();
+    gRenderQueue.Clear();
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        const SceneNode& node = nodes[i];
+        if (!node.castsShadow || node.mesh == INVALID_MESH)
+            continue;
+        MeshHandle mesh = node.lod.count > 1 ? node.lod.levels[node.lod.count - 1] : node.mesh;
+        gRenderQueue.Submit(&gShadowProgram, nullptr, mesh, node.world, node.normalMatrix, 0.0f);
+    }
+    gRenderQueue.Sort();
+
+    GLint target = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+    gShadowMap.Begin();
+    gRenderQueue.Flush(gMeshes, gMaterials);
+    gShadowMap.End();
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)target);
+    glViewport(0, 0, gViewportSize.x, gViewportSize.y);
+}
 
 
+//TEDDIE - once a second, show how many binds the render queue issued vs skipped last frame,
+//TEDDIE - summed over its passes (the deferred path draws the queue twice)
+void UReportRenderStats()
+{
+    static double lastReport = 0.0;
+    double now = glfwGetTime();
+    if (now - lastReport < 1.0)
+        return;
+    lastReport = now;
+
+    const RenderStats& stats = gRenderQueue.Stats();
+    char title[512];
+    const CullStats& cull = gCuller.Stats();
+    const LodStats& lod = gLod.Stats();
+    const ClusterStats& lights = gLightClusters.Stats();
+    const char* renderer = gDeferred ? "deferred" : (gDepthPrepass ? "forward + depth pre-pass" : "forward");
+    const PacingStats pacing = gPacer.Stats();
+    snprintf(title, sizeof(title), "%s | %.2f ms (sd %.2f, vsync %d) | %s, %.2fM fragments | lights %d (max %d per cluster, %d shadow rebuilds) | objects %d (%d culled, lod %d/%d/%d/%d) in %d draws / %d multi-draws over %d passes | program %d/%d | texture %d/%d | vao %d/%d (issued/elided)",
+        WINDOW_TITLE, pacing.meanMs, pacing.stdDevMs, gPacer.SwapInterval(), renderer, gFragments.Last() / 1.0e6, lights.lights, lights.maxPerCluster, gShadowMap.Rebuilds(), stats.instances, cull.culled, lod.objects[0], lod.objects[1], lod.objects[2], lod.objects[3], stats.draws, stats.multiDraws, stats.passes,
+        stats.programBinds, stats.programBindsElided,
+        stats.textureBinds, stats.textureBindsElided,
+        stats.vaoBinds, stats.vaoBindsElided);
+    glfwSetWindowTitle(gWindow, title);
 }
 
 
@@ -985,7 +1921,6 @@ void UCreateMesh(GLMesh& mesh)
     const GLuint floatsPerVertex = 3;
     const GLuint floatsPerNormal = 3;
     const GLuint floatsPerUV = 2;
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
 
     //TEDDIE - DO NOT TOUCH THIS IS PERFECT AND YOU WILL HATE YOURSELF IF YOU MUCK THIS UP
     GLfloat planeVerts[] = {
@@ -1405,361 +2340,384 @@ void UCreateMesh(GLMesh& mesh)
 
     
 
-    mesh.nVertices[0] = sizeof(coneVerts) / (sizeof(coneVerts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-    mesh.nVertices[1] = sizeof(coneVerts) / (sizeof(coneVerts[1]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-    mesh.nVertices[2] = sizeof(planeVerts) / (sizeof(planeVerts[2]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-    mesh.nVertices[11] = sizeof(pyramidVerts) / (sizeof(pyramidVerts[11]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-    mesh.nVertices[12] = sizeof(cubeVerts) / (sizeof(cubeVerts[12]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-    mesh.nVertices[13] = sizeof(domeVerts) / (sizeof(domeVerts[13]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-   mesh.nVertices[14] = sizeof(limeVerts) / (sizeof(limeVerts[14]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-
-    //TEDDIE - Spike 1
-    glGenVertexArrays(1, &mesh.vao[0]);
-    glGenBuffers(1, &mesh.vbo[0]);
-    glBindVertexArray(mesh.vao[0]);
-
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[0]); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(coneVerts), coneVerts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-
-    //TEDDIE - Spike 2
-    glGenVertexArrays(1, &mesh.vao[1]);
-    glGenBuffers(1, &mesh.vbo[1]);
-    glBindVertexArray(mesh.vao[1]);
-
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[1]); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(coneVerts), coneVerts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
+    const GLuint floatsPerMeshVertex = floatsPerVertex + floatsPerNormal + floatsPerUV;
 
+    //TEDDIE - every shape is welded into an indexed mesh and cache-optimised by the registry
+    //TEDDIE - Spikes (both drink cones share it)
+    mesh.cone = gMeshes.AddStatic("cone", coneVerts, sizeof(coneVerts) / (sizeof(coneVerts[0]) * floatsPerMeshVertex));
     //TEDDIE - SHELF
-    glGenVertexArrays(1, &mesh.vao[2]);
-    glGenBuffers(1, &mesh.vbo[2]);
-    glBindVertexArray(mesh.vao[2]);
-
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[2]); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(planeVerts), planeVerts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-
-    //TEDDIE - Coaster - Cork
-    glGenVertexArrays(1, &mesh.vao[3]);
-    glGenBuffers(1, &mesh.vbo[3]);
-    glBindVertexArray(mesh.vao[3]);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[3]);
-
-    glGenVertexArrays(1, &mesh.vao[4]);
-    glGenBuffers(1, &mesh.vbo[4]);
-    glBindVertexArray(mesh.vao[4]);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[4]);
-
-    glGenVertexArrays(1, &mesh.vao[5]);
-    glGenBuffers(1, &mesh.vbo[5]);
-    glBindVertexArray(mesh.vao[5]);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[5]);
-
-    glGenVertexArrays(1, &mesh.vao[6]);
-    glGenBuffers(1, &mesh.vbo[6]);
-    glBindVertexArray(mesh.vao[6]);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[6]);
-
-    glGenVertexArrays(1, &mesh.vao[7]);
-    glGenBuffers(1, &mesh.vbo[7]);
-    glBindVertexArray(mesh.vao[7]);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[7]);
-
-    //TEDDIE - Coaster - Ceramic
-    glGenVertexArrays(1, &mesh.vao[8]);
-    glGenBuffers(1, &mesh.vbo[8]);
-    glBindVertexArray(mesh.vao[8]);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[8]);
-
-    glGenVertexArrays(1, &mesh.vao[9]);
-    glGenBuffers(1, &mesh.vbo[9]);
-    glBindVertexArray(mesh.vao[9]);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[9]);
-
-    glGenVertexArrays(1, &mesh.vao[10]);
-    glGenBuffers(1, &mesh.vbo[10]);
-    glBindVertexArray(mesh.vao[10]);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[10]);
+    mesh.plane = gMeshes.AddStatic("plane", planeVerts, sizeof(planeVerts) / (sizeof(planeVerts[0]) * floatsPerMeshVertex));
+    //TEDDIE - WASP NEST
+    mesh.pyramid = gMeshes.AddStatic("pyramid", pyramidVerts, sizeof(pyramidVerts) / (sizeof(pyramidVerts[0]) * floatsPerMeshVertex));
+    //TEDDIE - CUBEEEEEE
+    mesh.cube = gMeshes.AddStatic("cube", cubeVerts, sizeof(cubeVerts) / (sizeof(cubeVerts[0]) * floatsPerMeshVertex));
+    //TEDDIE - DOME 2 only ever drew the first limeVerts-worth of domeVerts, keep it that way
+    mesh.dome = gMeshes.AddStatic("dome", domeVerts, sizeof(limeVerts) / (sizeof(limeVerts[0]) * floatsPerMeshVertex));
+}
 
+//TEDDIE - build every procedural mesh the scene uses once and keep it on the GPU
+//TEDDIE - objects with the same shape (all the coasters) share one mesh
+void UCreatePrimitives()
+{
+    //TEDDIE - every primitive is a LOD chain, each level about half the sectors (and stacks) of the last
+
+    //TEDDIE - cork and ceramic coasters
+    gCylinderLod = gMeshes.AcquireChain(MeshKey::MakeCylinder(1.0f, 30, 3.0f));
+    gCoasterLod = gMeshes.AcquireChain(MeshKey::MakeCoaster(1.0f, 30, 3.0f));
+
+    //TEDDIE - lime rind sphere (radius 2, flat shaded)
+    gLimeRindLod = gMeshes.AcquireChain(MeshKey::MakeSphere(2.0f, 72, 24, false));
+    //TEDDIE - orb on the drink
+    gOrbLod = gMeshes.AcquireChain(MeshKey::MakeSphere2(0.4f, 30, 10));
+    //TEDDIE - small lime
+    gLimeLod = gMeshes.AcquireChain(MeshKey::MakeSphere(0.3f, 30, 10));
+}
 
-    //TEDDIE - WASP NEST
-    glGenVertexArrays(1, &mesh.vao[11]);
-    glGenBuffers(1, &mesh.vbo[11]);
-    glBindVertexArray(mesh.vao[11]);
 
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[11]); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(pyramidVerts), pyramidVerts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+//TEDDIE - place every object in the scene (positions are the final ones, DO NOT TOUCH)
+void UCreateScene()
+{
+    //TEDDIE - both drink cones and the lamp markers are the same coneVerts, so they share one mesh
+    MeshHandle coneMesh = gMesh.cone;
+    MeshHandle planeMesh = gMesh.plane;
+    MeshHandle pyramidMesh = gMesh.pyramid;
+    MeshHandle cubeMesh = gMesh.cube;
+    MeshHandle domeMesh = gMesh.dome;
+
+    const float spike = 0.25f;
+    NodeId node;
+
+    //TEDDIE - CONES FOR DRINK
+    node = gScene.AddNode(coneMesh, drinkTex, &gProgram);
+    gScene.SetScale(node, glm::vec3(spike, 0.9f, spike));
+    gScene.SetRotation(node, 0.0f, glm::vec3(1.0, 1.0f, 1.0f));
+    gScene.SetPosition(node, glm::vec3(-0.545f, -0.5f, 0.0f));
+
+    node = gScene.AddNode(coneMesh, drinkTex, &gProgram);
+    gScene.SetScale(node, glm::vec3(spike, 0.6f, spike));
+    gScene.SetRotation(node, 3.1415f, glm::vec3(1.0f, 0.0f, 0.0f));
+    gScene.SetPosition(node, glm::vec3(-0.545f, 0.3f, 0.0f));
+
+    //TEDDIE - PLANE
+    node = gScene.AddNode(planeMesh, planeTex, &gProgram);
+    gScene.SetScale(node, glm::vec3(2.0f, 1.0f, 1.5f));
+
+    //TEDDIE - cork coasters
+    const glm::vec3 corkPositions[] = {
+        glm::vec3(-0.76f, -0.425f, -0.32f),
+        glm::vec3(-0.90f, -0.445f, -0.33f),
+        glm::vec3(-0.98f, -0.465f, -0.26f),
+        glm::vec3(-0.98f, -0.485f, -0.18f)
+    };
+    for (int i = 0; i < 4; ++i)
+    {
+        node = gScene.AddNode(i < 3 ? gCylinderLod : gCoasterLod, corkTex, &gProgram);
+        gScene.SetScale(node, glm::vec3(0.26f, 0.005f, 0.26f));
+        gScene.SetRotation(node, 45.0f, glm::vec3(0.0, 1.0f, 0.0f));
+        gScene.SetPosition(node, corkPositions[i]);
+    }
+
+    //TEDDIE - ceramic coasters
+    const glm::vec3 ceramicPositions[] = {
+        glm::vec3(-0.76f, -0.43f, -0.32f),
+        glm::vec3(-0.90f, -0.45f, -0.33f),
+        glm::vec3(-0.98f, -0.47f, -0.26f),
+        glm::vec3(-0.98f, -0.49f, -0.18f)
+    };
+    for (int i = 0; i < 4; ++i)
+    {
+        node = gScene.AddNode(gCoasterLod, ceramicTex, &gProgram);
+        gScene.SetScale(node, glm::vec3(0.27f, 0.005f, 0.27f));
+        gScene.SetRotation(node, 45.0f, glm::vec3(0.0, 1.0f, 0.0f));
+        gScene.SetPosition(node, ceramicPositions[i]);
+    }
 
-                                                                                   // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
+    //TEDDIE - INSIDE LIME
+    node = gScene.AddNode(pyramidMesh, limeTex, &gProgram);
+    gScene.SetScale(node, glm::vec3(0.5f, 0.5f, 0.5f));
+    gScene.SetPosition(node, glm::vec3(-1.0f, 1.5f, -0.6f));
 
-    //TEDDIE - CUBEEEEEE
-    glGenVertexArrays(1, &mesh.vao[12]);
-    glGenBuffers(1, &mesh.vbo[12]);
-    glBindVertexArray(mesh.vao[12]);
-
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[12]); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVerts), cubeVerts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-                                                                                 // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-
-    //TEDDIE - DOME
-    glGenVertexArrays(1, &mesh.vao[13]); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao[13]);
-
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.vbo[13]);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[13]); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(domeVerts), domeVerts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-
-    //TEDDIE - DOME
-    glGenVertexArrays(1, &mesh.vao[14]); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao[14]);
-
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.vbo[14]);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[14]); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(domeVerts), domeVerts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
+    //TEDDIE - MORBID BOX
+    node = gScene.AddNode(cubeMesh, morbidTex, &gProgram);
+    gScene.SetScale(node, glm::vec3(0.5f, 0.35f, 0.35f));
+    gScene.SetRotation(node, 15.0f, glm::vec3(0.0, 0.27f, 0.0f));
+    gScene.SetPosition(node, glm::vec3(0.7f, -0.3f, -0.4f));
 
-    //TEDDIE - WASP NEST
-    glGenVertexArrays(1, &mesh.vao[11]);
-    glGenBuffers(1, &mesh.vbo[11]);
-    glBindVertexArray(mesh.vao[11]);
-
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[11]); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(pyramidVerts), pyramidVerts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-                                                                                   // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-
-    Sphere sphere;
-    // copy interleaved vertex data (V/N/T) to VBO
-    GLuint vboId;
-    glGenBuffers(1, &vboId);
-    glBindBuffer(GL_ARRAY_BUFFER, vboId);           // for vertex data
-    glBufferData(GL_ARRAY_BUFFER,                   // target
-        sphere.getInterleavedVertexSize(), // data size, # of bytes
-        sphere.getInterleavedVertices(),   // ptr to vertex data
-        GL_STATIC_DRAW);                   // usage
-
-// copy index data to VBO
-    GLuint iboId;
-    glGenBuffers(1, &iboId);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iboId);   // for index data
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,           // target
-        sphere.getIndexSize(),             // data size, # of bytes
-        sphere.getIndices(),               // ptr to index data
-        GL_STATIC_DRAW);                   // usage
-
-
-        // bind VBOs
-    glBindBuffer(GL_ARRAY_BUFFER, vboId);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iboId);
-
-    // activate attrib arrays
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-
-    // set attrib arrays with stride and offset
-    int strideSphere = sphere.getInterleavedStride();     // should be 32 bytes
-    glVertexAttribPointer(0, 3, GL_FLOAT, false, strideSphere, (void*)0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, false, strideSphere, (void*)(sizeof(float) * 3));
-    glVertexAttribPointer(2, 2, GL_FLOAT, false, strideSphere, (void*)(sizeof(float) * 6));
-
-    // draw a sphere with VBO
-    glDrawElements(GL_TRIANGLES,                    // primitive type
-        sphere.getIndexCount(),          // # of indices
-        GL_UNSIGNED_INT,                 // data type
-        (void*)0);                       // offset to indices
-
-// deactivate attrib arrays
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(2);
-
-    // unbind VBOs
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    //TEDDIE - DOME THING 2
+    NodeId dome = gScene.AddNode(domeMesh, limeTex, &gProgram);
+    gScene.SetScale(dome, glm::vec3(0.22f, 0.15f, 0.15f));
+    gScene.SetRotation(dome, 90.0f, glm::vec3(1.5f, -0.4f, 0.5f));
+    gScene.SetPosition(dome, glm::vec3(0.0f, -0.45f, -0.45f));
+
+    //TEDDIE - LIME RIND sphere always drew with the dome's model matrix, so it hangs off the dome
+    gScene.AddNode(gLimeRindLod, sphereTex, &gProgram, dome);
+
+    //TEDDIE - SPHERE FOR ON DRINK THING
+    node = gScene.AddNode(gOrbLod, sphereTex, &gProgram);
+    gScene.SetScale(node, glm::vec3(0.35f, 0.35f, 0.35f));
+    gScene.SetRotation(node, 45.0f, glm::vec3(-0.85f, -0.7f, 0.1f));
+    gScene.SetPosition(node, glm::vec3(-0.545f, 0.38f, 0.0f));
 
+    //TEDDIE - LIME RIND
+    node = gScene.AddNode(gLimeLod, rindTex, &gProgram);
+    gScene.SetScale(node, glm::vec3(0.45f, 0.45f, 0.45f));
+    gScene.SetRotation(node, 45.0f, glm::vec3(-1.85f, -0.7f, 0.1f));
+    gScene.SetPosition(node, glm::vec3(0.0f, -0.4f, -0.5f));
+
+    //TEDDIE - cone used as a visual cue for the key light, drawn with the lamp program
+    gLampNode = gScene.AddNode(coneMesh, NO_MATERIAL, &gLightProgram);
+    gScene.SetScale(gLampNode, gLightScale);
+    gScene.SetPosition(gLampNode, gLightPosition);
+    gScene.SetCastsShadow(gLampNode, false);
 }
 
-void UDestroyMesh(GLMesh& mesh)
+
+//TEDDIE - uniform buffer for the per-frame camera and light data
+void UCreateFrameUniforms()
 {
-    glDeleteVertexArrays(20, mesh.vao);
-    glDeleteBuffers(20, mesh.vbo);
+    gFrameUbo.Create("frame uniforms");
+    glBindBuffer(GL_UNIFORM_BUFFER, gFrameUbo.Id());
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    gFrameUbo.SetSize(sizeof(FrameUniforms));
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, gFrameUbo.Id());
+
+    gProgram.BindUniformBlock("FrameData", FRAME_UNIFORMS_BINDING);
+    gLightProgram.BindUniformBlock("FrameData", FRAME_UNIFORMS_BINDING);
+    gGBufferProgram.BindUniformBlock("FrameData", FRAME_UNIFORMS_BINDING);
+    gDeferredProgram.BindUniformBlock("FrameData", FRAME_UNIFORMS_BINDING);
+    gShadowProgram.BindUniformBlock("FrameData", FRAME_UNIFORMS_BINDING);
+    gDepthProgram.BindUniformBlock("FrameData", FRAME_UNIFORMS_BINDING);
 }
 
 
-/*Generate and load the texture*/
-bool UCreateTexture(const char* filename, GLuint& textureId)
+//TEDDIE - the key and fill lights exactly as they were hard-coded in the Phong shader, then
+//TEDDIE - --lights small coloured point lights scattered over the shelf (same layout every run)
+void UCreateLights()
 {
-    int width, height, channels;
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-    if (image)
+    gLights.clear();
+    gLights.push_back(PointLight::Make(gLightPosition, 0.0f, gLightColor, 0.2f, 0.3f, 2.0f));
+    gLights.push_back(PointLight::Make(gFillPosition, 0.0f, gFillColor, 0.1f, 0.5f, 8.0f));
+
+    unsigned int seed = 12345u;
+    for (int i = 0; i < gOptions.lights; ++i)
     {
-        flipImageVertically(image, width, height, channels);
-
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
-
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        //TEDDIE - was getting an access violation error due to channel issue - specifically for waspy.jpg
-        //TEDDIE - solution source: https://stackoverflow.com/questions/9950546/c-opengl-glteximage2d-access-violation
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-        if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        else if (channels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        else
+        float r[7];
+        for (int j = 0; j < 7; ++j)
         {
-            cout << "Not implemented to handle image with " << channels << " channels" << endl;
-            return false;
+            seed = seed * 1664525u + 1013904223u;
+            r[j] = (seed >> 8) / 16777216.0f;
         }
+        glm::vec3 position(-2.0f + 4.0f * r[0], -0.4f + 1.4f * r[1], -1.5f + 3.0f * r[2]);
+        glm::vec3 color = glm::vec3(r[3], r[4], r[5]) * 0.6f;
+        gLights.push_back(PointLight::Make(position, 0.4f + 0.6f * r[6], color, 0.0f, 0.5f, 8.0f));
+    }
 
-        glGenerateMipmap(GL_TEXTURE_2D);
+    gLightClusters.Init(LIGHTS_BINDING, LIGHT_CLUSTERS_BINDING, LIGHT_INDICES_BINDING);
+    cout << "INFO: " << gLights.size() << " lights, " << LightClusters::CLUSTERS << " clusters ("
+        << LightClusters::TILES_X << "x" << LightClusters::TILES_Y << " tiles x " << LightClusters::SLICES << " slices)" << endl;
+}
 
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
 
-        return true;
-    }
+//TEDDIE - write the whole block in one go once per frame
+void UUpdateFrameUniforms(const glm::mat4& view, const glm::mat4& projection)
+{
+    FrameUniforms frame;
+    frame.view = view;
+    frame.projection = projection;
+    frame.viewPosition = glm::vec4(gCamera.Position, 1.0f);
+    frame.clusterTiles = glm::vec4((float)LightClusters::TILES_X / gViewportSize.x, (float)LightClusters::TILES_Y / gViewportSize.y,
+        (float)LightClusters::TILES_X, (float)LightClusters::TILES_Y);
+    frame.clusterSlices = gLightClusters.SliceParams();
+    frame.clusterSlices.w = (float)LightClusters::SLICES;
+    frame.lightCounts = glm::vec4((float)gLightClusters.Stats().globalLights, (float)gLightClusters.Stats().lights, 0.0f, 0.0f);
+    frame.shadowMatrix = gShadowMap.Matrix();
+
+    glBindBuffer(GL_UNIFORM_BUFFER, gFrameUbo.Id());
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
 
-    // Error loading the image
-    return false;
+
+/*Generate and load the texture*/
+//TEDDIE - registers the image as a material; gMaterials.Build() gives it a layer or atlas rect
+//TEDDIE - and gTextures streams it in later; only fails when the file is missing
+bool UCreateTexture(const char* filename, MaterialId& material)
+{
+    return gMaterials.Add(filename, material);
 }
 
 
-void UDestroyTexture(GLuint textureId)
+//TEDDIE - the #version line, then the shared FrameData block and chunk (if any), then the rest of the shader
+std::string UAssembleShader(const char* source, const char* chunk)
 {
-    glGenTextures(1, &textureId);
+    const char* body = strchr(source, '\n');
+    body = body ? body + 1 : source + strlen(source);
+    std::string assembled(source, body);
+    assembled += frameDataShaderSource;
+    if (chunk)
+        assembled += chunk;
+    assembled += body;
+    return assembled;
 }
 
 
 // Implements the UCreateShaders function
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+//TEDDIE - split in two: this loads the cached binary or issues the compiles and the link
+//TEDDIE - without asking for any status (which would wait for the driver), and
+//TEDDIE - UFinishShaderPrograms checks the results later
+//TEDDIE - fragChunk is shared GLSL the fragment shader builds on, e.g. lightingShaderSource
+bool UQueueShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, ShaderProgram& program, const char* fragChunk)
 {
-    // Compilation and linkage error reporting
-    int success = 0;
-    char infoLog[512];
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-    // Create a Shader program object.
-    programId = glCreateProgram();
+    //TEDDIE - the key covers the assembled sources so an edit to a shared block misses the cache
+    const std::string vertexSource = UAssembleShader(vtxShaderSource, nullptr);
+    const std::string fragmentSource = UAssembleShader(fragShaderSource, fragChunk);
+    const char* vertexText = vertexSource.c_str();
+    const char* fragmentText = fragmentSource.c_str();
 
-    // Create the vertex and fragment shader objects
-    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+    PendingProgram pending;
+    pending.program = &program;
+    pending.key = gProgramCache.Key(vertexText, fragmentText);
+    pending.cached = false;
 
-    // Retrive the shader source
-    glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
-    glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
+    // Create a Shader program object.
+    //TEDDIE - owning wrappers: the early returns below no longer leak the shaders or the program
+    if (!pending.object.Create(program.Label()))
+        return false;
+    const GLuint programId = pending.object.Id();
 
-    // Compile the vertex shader, and print compilation errors (if any)
-    glCompileShader(vertexShaderId); // compile the vertex shader
-    // check for shader compile errors
-    glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
+    //TEDDIE - same sources on the same driver as last time: no compile at all
+    pending.cached = gProgramCache.Load(program.Label(), pending.key, programId);
+    if (!pending.cached)
     {
-        glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+        // Create the vertex and fragment shader objects
+        if (!pending.vertex.Create(program.Label() + " vertex", GL_VERTEX_SHADER) || !pending.fragment.Create(program.Label() + " fragment", GL_FRAGMENT_SHADER))
+            return false;
+        const GLuint vertexShaderId = pending.vertex.Id();
+        const GLuint fragmentShaderId = pending.fragment.Id();
 
-        return false;
-    }
+        // Retrive the shader source
+        glShaderSource(vertexShaderId, 1, &vertexText, NULL);
+        glShaderSource(fragmentShaderId, 1, &fragmentText, NULL);
 
-    glCompileShader(fragmentShaderId); // compile the fragment shader
-    // check for shader compile errors
-    glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+        glCompileShader(vertexShaderId); // compile the vertex shader
+        glCompileShader(fragmentShaderId); // compile the fragment shader
 
-        return false;
+        // Attached compiled shaders to the shader program
+        glAttachShader(programId, vertexShaderId);
+        glAttachShader(programId, fragmentShaderId);
+
+        gProgramCache.PrepareForSave(programId);
+        glLinkProgram(programId);   // links the shader program
     }
 
-    // Attached compiled shaders to the shader program
-    glAttachShader(programId, vertexShaderId);
-    glAttachShader(programId, fragmentShaderId);
+    gPendingPrograms.push_back(std::move(pending));
+    gProgramMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+
+//TEDDIE - waits for every queued program, reports compile / link errors, saves new binaries
+//TEDDIE - to the cache and hands the programs over
+bool UFinishShaderPrograms()
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Compilation and linkage error reporting
+    int success = 0;
+    char infoLog[512];
+
+    //TEDDIE - how many were still compiling in the background when we got here
+    int stillCompiling = 0;
+    if (GLEW_KHR_parallel_shader_compile)
+    {
+        for (size_t i = 0; i < gPendingPrograms.size(); ++i)
+        {
+            GLint done = GL_TRUE;
+            glGetProgramiv(gPendingPrograms[i].object.Id(), GL_COMPLETION_STATUS_KHR, &done);
+            stillCompiling += done ? 0 : 1;
+        }
+    }
 
-    glLinkProgram(programId);   // links the shader program
-    // check for linking errors
-    glGetProgramiv(programId, GL_LINK_STATUS, &success);
-    if (!success)
+    bool ok = true;
+    int compiled = 0;
+    for (size_t i = 0; i < gPendingPrograms.size(); ++i)
     {
-        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        PendingProgram& pending = gPendingPrograms[i];
+        const GLuint programId = pending.object.Id();
 
-        return false;
+        if (!pending.cached)
+        {
+            ++compiled;
+            // check for linking errors (waits for the compile and link if they are still running)
+            glGetProgramiv(programId, GL_LINK_STATUS, &success);
+            if (!success)
+            {
+                // check for shader compile errors
+                glGetShaderiv(pending.vertex.Id(), GL_COMPILE_STATUS, &success);
+                if (!success)
+                {
+                    glGetShaderInfoLog(pending.vertex.Id(), sizeof(infoLog), NULL, infoLog);
+                    std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+                }
+                glGetShaderiv(pending.fragment.Id(), GL_COMPILE_STATUS, &success);
+                if (!success)
+                {
+                    glGetShaderInfoLog(pending.fragment.Id(), sizeof(infoLog), NULL, infoLog);
+                    std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+                }
+                glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+                std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+
+                ok = false;
+                break;
+            }
+
+            //TEDDIE - shaders are baked into the program now, the wrappers delete them below
+            glDetachShader(programId, pending.vertex.Id());
+            glDetachShader(programId, pending.fragment.Id());
+            pending.vertex.Reset();
+            pending.fragment.Reset();
+
+            gProgramCache.Save(pending.program->Label(), pending.key, programId);
+        }
+
+        //TEDDIE - enumerate active uniforms / attributes once so nothing is looked up per frame
+        pending.program->Reflect(std::move(pending.object));
     }
+    gPendingPrograms.clear();
 
-    glUseProgram(programId);    // Uses the shader program
+    gProgramMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (ok)
+    {
+        char line[160];
+        snprintf(line, sizeof(line), "INFO: Shader programs ready in %.2f ms (%d from cache, %d compiled%s, %d still compiling after the meshes)",
+            gProgramMs, gProgramCache.Hits(), compiled,
+            GLEW_KHR_parallel_shader_compile ? " in parallel" : "", stillCompiling);
+        std::cout << line << std::endl;
+    }
+    return ok;
+}
 
-    return true;
+
+//TEDDIE - start-up cost as the user sees it: main() to the first frame finished on the GPU.
+//TEDDIE - run once with --no-program-cache (or an empty cache) and once warm to compare
+void UReportFirstFrame()
+{
+    glFinish();
+    gFirstFrameDone = true;
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - gStartTime).count();
+
+    char line[160];
+    snprintf(line, sizeof(line), "INFO: Time to first frame %.2f ms (shader programs %.2f ms, program cache %s)",
+        ms, gProgramMs, !gProgramCache.Enabled() ? "off" : gProgramCache.Misses() == 0 ? "warm" : "cold");
+    std::cout << line << std::endl;
 }
 
 
-void UDestroyShaderProgram(GLuint programId)
+void UDestroyShaderProgram(ShaderProgram& program)
 {
-    glDeleteProgram(programId);
+    program.Destroy();
 }
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+
+#include <GL/glew.h>
+
+// Fragment shader invocations over one stretch of every frame, counted with
+// ARB_pipeline_statistics_query. Each frame's query is read back
+// FRAMES_IN_FLIGHT frames later, like the profiler's timestamps, so counting
+// never stalls the pipeline; a result still not available by then is
+// dropped. Without the extension Begin() / End() do nothing.
+class FragmentCounter
+{
+public:
+    static const int FRAMES_IN_FLIGHT = 4;
+
+    FragmentCounter() : mSupported(false), mFrame(0), mLast(0), mTotal(0), mSamples(0)
+    {
+        for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
+        {
+            mQueries[i] = 0;
+            mPending[i] = false;
+        }
+    }
+
+    // Needs a current context
+    void Init()
+    {
+        mSupported = GLEW_ARB_pipeline_statistics_query != 0;
+        if (mSupported)
+            glGenQueries(FRAMES_IN_FLIGHT, mQueries);
+    }
+
+    bool Supported() const { return mSupported; }
+
+    void Begin()
+    {
+        if (!mSupported)
+            return;
+        const int slot = mFrame % FRAMES_IN_FLIGHT;
+        Collect(slot, false);
+        glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, mQueries[slot]);
+    }
+
+    void End()
+    {
+        if (!mSupported)
+            return;
+        glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+        mPending[mFrame % FRAMES_IN_FLIGHT] = true;
+        ++mFrame;
+    }
+
+    // Waits for every outstanding result, oldest first
+    void Flush()
+    {
+        for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
+            Collect((mFrame + i) % FRAMES_IN_FLIGHT, true);
+    }
+
+    // Newest result collected
+    uint64_t Last() const { return mLast; }
+    // Mean per frame over the results collected since Reset()
+    double Average() const { return mSamples ? (double)mTotal / mSamples : 0.0; }
+    void Reset()
+    {
+        mTotal = 0;
+        mSamples = 0;
+    }
+
+    void Release()
+    {
+        if (mSupported)
+            glDeleteQueries(FRAMES_IN_FLIGHT, mQueries);
+        mSupported = false;
+    }
+
+private:
+    void Collect(int slot, bool wait)
+    {
+        if (!mPending[slot])
+            return;
+        mPending[slot] = false;
+        if (!wait)
+        {
+            GLuint available = 0;
+            glGetQueryObjectuiv(mQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return;
+        }
+        GLuint64 count = 0;
+        glGetQueryObjectui64v(mQueries[slot], GL_QUERY_RESULT, &count);
+        mLast = count;
+        mTotal += count;
+        ++mSamples;
+    }
+
+    bool mSupported;
+    GLuint mQueries[FRAMES_IN_FLIGHT];
+    bool mPending[FRAMES_IN_FLIGHT];
+    int mFrame;
+    uint64_t mLast;
+    uint64_t mTotal;
+    uint64_t mSamples;
+};
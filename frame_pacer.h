@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <thread>
+
+#include <GLFW/glfw3.h>
+
+// Mean / spread of the time between presented frames, in milliseconds
+struct PacingStats
+{
+    float meanMs;
+    float stdDevMs;
+    float maxMs;
+    size_t frames;
+};
+
+// Owns presentation: Present() is the only place the window's buffers are
+// swapped. It sets the swap interval (vsync), optionally caps the frame rate
+// and keeps the last HISTORY present-to-present times for their variance.
+//
+// The cap keeps a deadline per frame. Sleeping alone overshoots by up to a
+// scheduler tick, so Present() sleeps until the measured oversleep before
+// the deadline and spins the rest. The margin follows the worst recent
+// oversleep and slowly decays. A frame that misses its deadline by more
+// than a whole frame restarts the schedule rather than rushing to catch up.
+class FramePacer
+{
+public:
+    static const size_t HISTORY = 240;
+
+    FramePacer() : mWindow(nullptr), mSwapInterval(0), mTargetFps(0.0f), mFrameMs(0.0), mSleepSlackMs(1.0)
+    {
+        mLastPresent = mDeadline = Clock::now();
+    }
+
+    // window may be null (headless): then only the cap and the timing apply
+    void Init(GLFWwindow* window, int swapInterval, float targetFps)
+    {
+        mWindow = window;
+        SetSwapInterval(swapInterval);
+        SetTargetFps(targetFps);
+        mLastPresent = mDeadline = Clock::now();
+        mHistory.clear();
+    }
+
+    // 0 = off, 1 = every refresh, -1 = adaptive (tears instead of waiting
+    // another refresh when late), which falls back to 1 if unsupported
+    void SetSwapInterval(int interval)
+    {
+        if (interval < 0 && mWindow && !glfwExtensionSupported("WGL_EXT_swap_control_tear")
+            && !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+        {
+            std::cout << "WARNING: Adaptive vsync not supported, using vsync" << std::endl;
+            interval = 1;
+        }
+        mSwapInterval = interval;
+        if (mWindow)
+            glfwSwapInterval(interval);
+    }
+
+    int SwapInterval() const { return mSwapInterval; }
+
+    // 0 = no cap
+    void SetTargetFps(float fps)
+    {
+        mTargetFps = std::max(fps, 0.0f);
+        mFrameMs = mTargetFps > 0.0f ? 1000.0 / mTargetFps : 0.0;
+        mDeadline = Clock::now();
+    }
+
+    float TargetFps() const { return mTargetFps; }
+
+    // Waits for the cap, if any, then swaps
+    void Present()
+    {
+        if (mFrameMs > 0.0)
+            WaitForDeadline();
+        if (mWindow)
+            glfwSwapBuffers(mWindow);
+
+        const Clock::time_point now = Clock::now();
+        mHistory.push_back((float)Milliseconds(now - mLastPresent));
+        if (mHistory.size() > HISTORY)
+            mHistory.pop_front();
+        mLastPresent = now;
+    }
+
+    PacingStats Stats() const
+    {
+        PacingStats stats = { 0.0f, 0.0f, 0.0f, mHistory.size() };
+        if (mHistory.empty())
+            return stats;
+
+        double total = 0.0;
+        for (size_t i = 0; i < mHistory.size(); ++i)
+        {
+            total += mHistory[i];
+            stats.maxMs = std::max(stats.maxMs, mHistory[i]);
+        }
+        const double mean = total / mHistory.size();
+        double variance = 0.0;
+        for (size_t i = 0; i < mHistory.size(); ++i)
+            variance += (mHistory[i] - mean) * (mHistory[i] - mean);
+        stats.meanMs = (float)mean;
+        stats.stdDevMs = (float)std::sqrt(variance / mHistory.size());
+        return stats;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static double Milliseconds(Clock::duration duration)
+    {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    void WaitForDeadline()
+    {
+        const std::chrono::duration<double, std::milli> frame(mFrameMs);
+        Clock::time_point now = Clock::now();
+        mDeadline += std::chrono::duration_cast<Clock::duration>(frame);
+        if (mDeadline + std::chrono::duration_cast<Clock::duration>(frame) < now)
+            mDeadline = now;
+
+        const double remainingMs = Milliseconds(mDeadline - now);
+        if (remainingMs > mSleepSlackMs)
+        {
+            const std::chrono::duration<double, std::milli> request(remainingMs - mSleepSlackMs);
+            std::this_thread::sleep_for(request);
+            const double oversleepMs = Milliseconds(Clock::now() - now) - request.count();
+            mSleepSlackMs = std::max(std::max(oversleepMs, mSleepSlackMs * 0.95), 0.25);
+        }
+        while (Clock::now() < mDeadline)
+            std::this_thread::yield();
+    }
+
+    GLFWwindow* mWindow;
+    int mSwapInterval;
+    float mTargetFps;
+    double mFrameMs;                // 0 = no cap
+    double mSleepSlackMs;           // how early sleeping stops before the deadline
+    Clock::time_point mDeadline;
+    Clock::time_point mLastPresent;
+    std::deque<float> mHistory;     // ms between presents, newest last
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_SSE 1
+#include <xmmintrin.h>
+#endif
+
+// Local-space bounds of a mesh, worked out once when it is built. The
+// sphere is centred on the box so both share one world-space centre.
+struct MeshBounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 center;
+    float radius;           // to the farthest vertex
+
+    // vertices: interleaved, position first, stride floats per vertex
+    static MeshBounds FromVertices(const float* vertices, size_t nVertices, int stride)
+    {
+        MeshBounds bounds;
+        bounds.min = bounds.max = nVertices ? glm::vec3(vertices[0], vertices[1], vertices[2]) : glm::vec3(0.0f);
+        for (size_t i = 1; i < nVertices; ++i)
+        {
+            const glm::vec3 p(vertices[i * stride], vertices[i * stride + 1], vertices[i * stride + 2]);
+            bounds.min = glm::min(bounds.min, p);
+            bounds.max = glm::max(bounds.max, p);
+        }
+        bounds.center = (bounds.min + bounds.max) * 0.5f;
+
+        float radiusSq = 0.0f;
+        for (size_t i = 0; i < nVertices; ++i)
+        {
+            const glm::vec3 d = glm::vec3(vertices[i * stride], vertices[i * stride + 1], vertices[i * stride + 2]) - bounds.center;
+            radiusSq = std::max(radiusSq, glm::dot(d, d));
+        }
+        bounds.radius = std::sqrt(radiusSq);
+        return bounds;
+    }
+};
+
+// Objects tested and rejected by the last Cull()
+struct CullStats
+{
+    int tested;
+    int culled;
+};
+
+// View-frustum culling for a frame's objects. Add() transforms each
+// object's bounds to world space (sphere plus the box's world extents)
+// and stores them structure-of-arrays; Cull() then tests four objects at
+// a time against the six planes of projection * view with SSE. An object
+// is culled when either its sphere or its box lies fully outside one
+// plane, so both bounds only ever remove objects that cannot be seen.
+class FrustumCuller
+{
+public:
+    FrustumCuller() : mCount(0)
+    {
+        mStats = CullStats();
+    }
+
+    // Planes from the combined matrix (Gribb / Hartmann), normals inward
+    void Begin(const glm::mat4& viewProjection)
+    {
+        const glm::mat4& m = viewProjection;
+        const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        const glm::vec4 planes[PLANES] = { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2 };
+        for (int i = 0; i < PLANES; ++i)
+            mPlanes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+
+        mCount = 0;
+        for (int i = 0; i < COMPONENTS; ++i)
+            mSoa[i].clear();
+        mVisible.clear();
+    }
+
+    // Returns the object's index for Visible()
+    int Add(const MeshBounds& bounds, const glm::mat4& model)
+    {
+        const glm::vec3 center = glm::vec3(model * glm::vec4(bounds.center, 1.0f));
+        const glm::vec3 axisX = glm::vec3(model[0]), axisY = glm::vec3(model[1]), axisZ = glm::vec3(model[2]);
+        const float scale = std::max(glm::length(axisX), std::max(glm::length(axisY), glm::length(axisZ)));
+
+        // world extents of the rotated box: |M| * local half size
+        const glm::vec3 half = (bounds.max - bounds.min) * 0.5f;
+        const glm::vec3 extent = glm::abs(axisX) * half.x + glm::abs(axisY) * half.y + glm::abs(axisZ) * half.z;
+
+        const float values[COMPONENTS] = { center.x, center.y, center.z, bounds.radius * scale, extent.x, extent.y, extent.z };
+        for (int i = 0; i < COMPONENTS; ++i)
+            mSoa[i].push_back(values[i]);
+        return mCount++;
+    }
+
+    void Cull()
+    {
+        // pad to whole groups of four; the padding's results are never read
+        const size_t padded = (mCount + 3) & ~(size_t)3;
+        for (int i = 0; i < COMPONENTS; ++i)
+            mSoa[i].resize(padded, 0.0f);
+        mVisible.assign(padded, 0);
+
+#ifdef FRUSTUM_SSE
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        for (size_t i = 0; i < padded; i += 4)
+        {
+            const __m128 cx = _mm_loadu_ps(&mSoa[CX][i]), cy = _mm_loadu_ps(&mSoa[CY][i]), cz = _mm_loadu_ps(&mSoa[CZ][i]);
+            const __m128 radius = _mm_loadu_ps(&mSoa[RADIUS][i]);
+            const __m128 ex = _mm_loadu_ps(&mSoa[EX][i]), ey = _mm_loadu_ps(&mSoa[EY][i]), ez = _mm_loadu_ps(&mSoa[EZ][i]);
+
+            __m128 inside = _mm_cmpeq_ps(zero, zero);
+            for (int p = 0; p < PLANES; ++p)
+            {
+                const __m128 nx = _mm_set1_ps(mPlanes[p].x), ny = _mm_set1_ps(mPlanes[p].y), nz = _mm_set1_ps(mPlanes[p].z);
+                const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                    _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(mPlanes[p].w)));
+                const __m128 boxRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex),
+                    _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)), _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+                // outside if d < -sphere radius or d < -box radius
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, _mm_min_ps(radius, boxRadius)), zero));
+            }
+
+            const int mask = _mm_movemask_ps(inside);
+            for (int lane = 0; lane < 4; ++lane)
+                mVisible[i + lane] = (uint8_t)((mask >> lane) & 1);
+        }
+#else
+        for (size_t i = 0; i < padded; ++i)
+        {
+            bool inside = true;
+            for (int p = 0; p < PLANES && inside; ++p)
+            {
+                const glm::vec4& plane = mPlanes[p];
+                const float distance = plane.x * mSoa[CX][i] + plane.y * mSoa[CY][i] + plane.z * mSoa[CZ][i] + plane.w;
+                const float boxRadius = std::fabs(plane.x) * mSoa[EX][i] + std::fabs(plane.y) * mSoa[EY][i] + std::fabs(plane.z) * mSoa[EZ][i];
+                inside = distance + std::min(mSoa[RADIUS][i], boxRadius) >= 0.0f;
+            }
+            mVisible[i] = inside ? 1 : 0;
+        }
+#endif
+
+        mStats.tested = mCount;
+        mStats.culled = 0;
+        for (int i = 0; i < mCount; ++i)
+            mStats.culled += mVisible[i] ? 0 : 1;
+    }
+
+    bool Visible(int index) const { return mVisible[index] != 0; }
+    const CullStats& Stats() const { return mStats; }
+
+private:
+    static const int PLANES = 6;
+    enum Component { CX, CY, CZ, RADIUS, EX, EY, EZ, COMPONENTS };
+
+    glm::vec4 mPlanes[PLANES];
+    std::vector<float> mSoa[COMPONENTS];
+    std::vector<uint8_t> mVisible;
+    int mCount;
+    CullStats mStats;
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <iostream>
+
+#include <GL/glew.h>
+
+#include "gpu_resources.h"
+
+// Render targets of the deferred path: albedo (RGBA8), world normal packed
+// to 0..1 (RGB10_A2) and depth (24 bit texture, so the lighting pass can
+// rebuild positions from it). 12 bytes per pixel. Created on first use and
+// rebuilt whenever the viewport size changes.
+class GBuffer
+{
+public:
+    static const GLuint ALBEDO_UNIT = 1;     // unit 0 is the material array
+    static const GLuint NORMAL_UNIT = 2;
+    static const GLuint DEPTH_UNIT = 3;
+
+    GBuffer() : mWidth(0), mHeight(0) {}
+
+    // Matches the targets to width x height; false if the FBO is incomplete
+    bool Ensure(int width, int height)
+    {
+        if (mFbo && width == mWidth && height == mHeight)
+            return true;
+        Release();
+        mWidth = width;
+        mHeight = height;
+
+        CreateTarget(mAlbedo, "gbuffer albedo", GL_RGBA8, 4);
+        CreateTarget(mNormal, "gbuffer normal", GL_RGB10_A2, 4);
+        CreateTarget(mDepth, "gbuffer depth", GL_DEPTH_COMPONENT24, 4);
+
+        // the lighting pass needs a VAO bound even though it reads no attributes
+        mFullscreenVao.Create("fullscreen triangle");
+
+        GLint previous = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+        mFbo.Create("gbuffer");
+        glBindFramebuffer(GL_FRAMEBUFFER, mFbo.Id());
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mAlbedo.Id(), 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, mNormal.Id(), 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mDepth.Id(), 0);
+        const GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, buffers);
+
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previous);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "WARNING: G-buffer incomplete: 0x" << std::hex << status << std::dec << std::endl;
+            Release();
+            return false;
+        }
+        return true;
+    }
+
+    // Binds the G-buffer and clears it: albedo and normal to 0, depth to 1
+    void BeginGeometry() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, mFbo.Id());
+        const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const GLfloat one = 1.0f;
+        glClearBufferfv(GL_COLOR, 0, zero);
+        glClearBufferfv(GL_COLOR, 1, zero);
+        glClearBufferfv(GL_DEPTH, 0, &one);
+    }
+
+    // Targets on their units for the lighting pass
+    void BindTextures() const
+    {
+        glActiveTexture(GL_TEXTURE0 + ALBEDO_UNIT);
+        glBindTexture(GL_TEXTURE_2D, mAlbedo.Id());
+        glActiveTexture(GL_TEXTURE0 + NORMAL_UNIT);
+        glBindTexture(GL_TEXTURE_2D, mNormal.Id());
+        glActiveTexture(GL_TEXTURE0 + DEPTH_UNIT);
+        glBindTexture(GL_TEXTURE_2D, mDepth.Id());
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // One triangle covering the viewport, positions made in the vertex shader
+    void DrawFullscreen() const
+    {
+        glBindVertexArray(mFullscreenVao.Id());
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+    }
+
+    void Release()
+    {
+        mFbo.Reset();
+        mAlbedo.Reset();
+        mNormal.Reset();
+        mDepth.Reset();
+        mFullscreenVao.Reset();
+        mWidth = mHeight = 0;
+    }
+
+private:
+    void CreateTarget(GpuTexture& texture, const char* label, GLenum format, int bytesPerPixel)
+    {
+        texture.Create(label);
+        glBindTexture(GL_TEXTURE_2D, texture.Id());
+        glTexStorage2D(GL_TEXTURE_2D, 1, format, mWidth, mHeight);
+        // read back one texel per pixel, never filtered
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        texture.SetSize((size_t)mWidth * mHeight * bytesPerPixel);
+    }
+
+    GpuFramebuffer mFbo;
+    GpuTexture mAlbedo;
+    GpuTexture mNormal;
+    GpuTexture mDepth;
+    GpuVertexArray mFullscreenVao;
+    int mWidth;
+    int mHeight;
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "gpu_resources.h"
+
+// Where one mesh lives inside the arena. Indices are local to the mesh;
+// baseVertex is added by GL at draw time.
+struct ArenaRange
+{
+    GLint baseVertex;
+    GLuint firstIndex;      // in indices, not bytes
+    GLsizei nIndices;
+};
+
+// One vertex buffer, one index buffer and one VAO shared by every mesh.
+// Meshes are appended (sub-allocated) and never freed individually, so the
+// whole scene draws with a single VAO bind and can be submitted with
+// glMultiDrawElementsIndirect. Both buffers double in size when full.
+class GeometryArena
+{
+public:
+    static const int FLOATS_PER_VERTEX = 8;    // position(3) normal(3) uv(2)
+    // 32-bit, so a mesh may have any number of vertices
+    static const GLenum INDEX_TYPE = GL_UNSIGNED_INT;
+
+    GeometryArena()
+        : mVertexCapacity(0), mIndexCapacity(0), mVertexCount(0), mIndexCount(0)
+    {
+    }
+
+    // Copies a mesh into the arena
+    bool Allocate(const std::vector<GLfloat>& vertices, const std::vector<GLuint>& indices, ArenaRange& range)
+    {
+        const size_t nVertices = vertices.size() / FLOATS_PER_VERTEX;
+
+        if (!mVao)
+            Create(1 << 16, 1 << 18);
+        Reserve(mVertexCount + nVertices, mIndexCount + indices.size());
+
+        glBindBuffer(GL_ARRAY_BUFFER, mVbo.Id());
+        glBufferSubData(GL_ARRAY_BUFFER, mVertexCount * VERTEX_SIZE, vertices.size() * sizeof(GLfloat), vertices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // the element buffer binding is VAO state, so go through the VAO
+        glBindVertexArray(mVao.Id());
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, mIndexCount * sizeof(GLuint), indices.size() * sizeof(GLuint), indices.data());
+        glBindVertexArray(0);
+
+        range.baseVertex = (GLint)mVertexCount;
+        range.firstIndex = (GLuint)mIndexCount;
+        range.nIndices = (GLsizei)indices.size();
+
+        mVertexCount += nVertices;
+        mIndexCount += indices.size();
+        return true;
+    }
+
+    GLuint Vao() const { return mVao.Id(); }
+    size_t VertexCount() const { return mVertexCount; }
+    size_t IndexCount() const { return mIndexCount; }
+
+    void Release()
+    {
+        mVao.Reset();
+        mVbo.Reset();
+        mIbo.Reset();
+        mVertexCapacity = mIndexCapacity = 0;
+        mVertexCount = mIndexCount = 0;
+    }
+
+private:
+    static const GLsizeiptr VERTEX_SIZE = sizeof(GLfloat) * FLOATS_PER_VERTEX;
+
+    void Create(size_t vertexCapacity, size_t indexCapacity)
+    {
+        mVao.Create("geometry arena");
+        mVbo = CreateBuffer("geometry arena vertices", vertexCapacity * VERTEX_SIZE);
+        mIbo = CreateBuffer("geometry arena indices", indexCapacity * sizeof(GLuint));
+        mVertexCapacity = vertexCapacity;
+        mIndexCapacity = indexCapacity;
+        BindLayout();
+    }
+
+    // Grows either buffer to at least the requested size, keeping contents
+    void Reserve(size_t vertices, size_t indices)
+    {
+        bool changed = false;
+        if (vertices > mVertexCapacity)
+        {
+            size_t capacity = mVertexCapacity;
+            while (capacity < vertices)
+                capacity *= 2;
+            mVbo = Grow("geometry arena vertices", mVbo, mVertexCount * VERTEX_SIZE, capacity * VERTEX_SIZE);
+            mVertexCapacity = capacity;
+            changed = true;
+        }
+        if (indices > mIndexCapacity)
+        {
+            size_t capacity = mIndexCapacity;
+            while (capacity < indices)
+                capacity *= 2;
+            mIbo = Grow("geometry arena indices", mIbo, mIndexCount * sizeof(GLuint), capacity * sizeof(GLuint));
+            mIndexCapacity = capacity;
+            changed = true;
+        }
+        if (changed)
+        {
+            std::cout << "INFO: Geometry arena grown to " << mVertexCapacity << " vertices, "
+                << mIndexCapacity << " indices" << std::endl;
+            BindLayout();
+        }
+    }
+
+    static GpuBuffer CreateBuffer(const char* label, size_t bytes)
+    {
+        GpuBuffer buffer;
+        buffer.Create(label);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.Id());
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        buffer.SetSize(bytes);
+        return buffer;
+    }
+
+    // The old buffer is deleted when the caller assigns the result over it
+    static GpuBuffer Grow(const char* label, const GpuBuffer& buffer, size_t usedBytes, size_t newBytes)
+    {
+        GpuBuffer grown = CreateBuffer(label, newBytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer.Id());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown.Id());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return grown;
+    }
+
+    // Points attributes 0-2 and the element buffer at the current buffers.
+    // Per-instance attributes set by the render queue are left alone.
+    void BindLayout()
+    {
+        glBindVertexArray(mVao.Id());
+        glBindBuffer(GL_ARRAY_BUFFER, mVbo.Id());
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIbo.Id());
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (GLsizei)VERTEX_SIZE, (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, (GLsizei)VERTEX_SIZE, (void*)(sizeof(GLfloat) * 3));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, (GLsizei)VERTEX_SIZE, (void*)(sizeof(GLfloat) * 6));
+        glEnableVertexAttribArray(2);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    GpuVertexArray mVao;
+    GpuBuffer mVbo;
+    GpuBuffer mIbo;
+    size_t mVertexCapacity;     // in vertices
+    size_t mIndexCapacity;      // in indices
+    size_t mVertexCount;
+    size_t mIndexCount;
+};
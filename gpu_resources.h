@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+
+#include <GL/glew.h>
+
+// Kinds of GL object the tracker accounts for
+enum class GpuCategory
+{
+    Buffer,
+    VertexArray,
+    Texture,
+    Renderbuffer,
+    Framebuffer,
+    Shader,
+    Program,
+    Count
+};
+
+inline const char* GpuCategoryName(GpuCategory category)
+{
+    switch (category)
+    {
+    case GpuCategory::Buffer: return "buffers";
+    case GpuCategory::VertexArray: return "vertex arrays";
+    case GpuCategory::Texture: return "textures";
+    case GpuCategory::Renderbuffer: return "renderbuffers";
+    case GpuCategory::Framebuffer: return "framebuffers";
+    case GpuCategory::Shader: return "shaders";
+    case GpuCategory::Program: return "programs";
+    default: return "unknown";
+    }
+}
+
+// Every live GL object created through a GpuObject, with its label and the
+// bytes of storage the owner says it holds. Reports totals per category on
+// demand, lists whatever is still alive at shutdown and warns once when the
+// total crosses the budget. Only touched from the GL thread, like GL itself.
+class GpuTracker
+{
+public:
+    struct Totals
+    {
+        int objects;
+        size_t bytes;
+    };
+
+    GpuTracker() : mBytes(0), mPeakBytes(0), mBudget(0), mOverBudget(false)
+    {
+        for (int i = 0; i < CATEGORIES; ++i)
+            mTotals[i] = Totals{ 0, 0 };
+    }
+
+    void Add(GpuCategory category, GLuint id, const std::string& label)
+    {
+        Entry entry = { label, 0 };
+        mLive[Key(category, id)] = entry;
+        ++mTotals[(int)category].objects;
+    }
+
+    // Storage behind an object changed (glBufferData, glTexStorage, ...)
+    void Resize(GpuCategory category, GLuint id, size_t bytes)
+    {
+        std::map<std::pair<int, GLuint>, Entry>::iterator it = mLive.find(Key(category, id));
+        if (it == mLive.end())
+            return;
+        Account(category, it->second.bytes, bytes);
+        it->second.bytes = bytes;
+    }
+
+    void Remove(GpuCategory category, GLuint id)
+    {
+        std::map<std::pair<int, GLuint>, Entry>::iterator it = mLive.find(Key(category, id));
+        if (it == mLive.end())
+            return;
+        Account(category, it->second.bytes, 0);
+        --mTotals[(int)category].objects;
+        mLive.erase(it);
+    }
+
+    // 0 = no budget
+    void SetBudget(size_t bytes)
+    {
+        mBudget = bytes;
+        mOverBudget = false;
+    }
+
+    Totals Total(GpuCategory category) const { return mTotals[(int)category]; }
+    size_t Bytes() const { return mBytes; }
+    size_t PeakBytes() const { return mPeakBytes; }
+    bool OverBudget() const { return mBudget > 0 && mBytes > mBudget; }
+
+    // Objects and bytes per category, then the overall total
+    void Report() const
+    {
+        std::cout << "INFO: GPU resources:" << std::endl;
+        char line[128];
+        for (int i = 0; i < CATEGORIES; ++i)
+        {
+            snprintf(line, sizeof(line), "  %-14s %5d objects %10.2f MB", GpuCategoryName((GpuCategory)i),
+                mTotals[i].objects, Megabytes(mTotals[i].bytes));
+            std::cout << line << std::endl;
+        }
+        snprintf(line, sizeof(line), "  %-14s %5d objects %10.2f MB (peak %.2f MB", "total", (int)mLive.size(),
+            Megabytes(mBytes), Megabytes(mPeakBytes));
+        std::cout << line;
+        if (mBudget > 0)
+            std::cout << ", budget " << Megabytes(mBudget) << " MB";
+        std::cout << ")" << std::endl;
+    }
+
+    // Lists everything still alive. Call after every owner released its
+    // objects; returns how many leaked.
+    int ReportLeaks() const
+    {
+        if (mLive.empty())
+        {
+            std::cout << "INFO: No GPU resources leaked" << std::endl;
+            return 0;
+        }
+        std::cout << "WARNING: " << mLive.size() << " GPU resources leaked (" << Megabytes(mBytes) << " MB):" << std::endl;
+        for (std::map<std::pair<int, GLuint>, Entry>::const_iterator it = mLive.begin(); it != mLive.end(); ++it)
+        {
+            std::cout << "  " << GpuCategoryName((GpuCategory)it->first.first) << " " << it->first.second
+                << " '" << it->second.label << "' " << it->second.bytes << " bytes" << std::endl;
+        }
+        return (int)mLive.size();
+    }
+
+private:
+    static const int CATEGORIES = (int)GpuCategory::Count;
+
+    struct Entry
+    {
+        std::string label;
+        size_t bytes;
+    };
+
+    static std::pair<int, GLuint> Key(GpuCategory category, GLuint id) { return std::make_pair((int)category, id); }
+    static double Megabytes(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+    void Account(GpuCategory category, size_t oldBytes, size_t newBytes)
+    {
+        mTotals[(int)category].bytes += newBytes - oldBytes;
+        mBytes += newBytes - oldBytes;
+        mPeakBytes = std::max(mPeakBytes, mBytes);
+
+        if (OverBudget() && !mOverBudget)
+            std::cout << "WARNING: GPU memory " << Megabytes(mBytes) << " MB is over the " << Megabytes(mBudget) << " MB budget" << std::endl;
+        mOverBudget = OverBudget();
+    }
+
+    std::map<std::pair<int, GLuint>, Entry> mLive;
+    Totals mTotals[CATEGORIES];
+    size_t mBytes;
+    size_t mPeakBytes;
+    size_t mBudget;
+    bool mOverBudget;       // warned already, until it drops back under
+};
+
+// The one tracker every GpuObject registers with. Never destroyed, so
+// global objects torn down at exit can still unregister.
+inline GpuTracker& GpuResources()
+{
+    static GpuTracker* tracker = new GpuTracker();
+    return *tracker;
+}
+
+// Owns one GL object name: created and registered by Create(), deleted and
+// unregistered by Reset() or the destructor. Move only. Owners report the
+// storage size with SetSize() so the tracker can account for it. Globals
+// must be Reset() before the context goes away; the destructor then has
+// nothing left to delete.
+template <GpuCategory Category>
+class GpuObject
+{
+public:
+    GpuObject() : mId(0) {}
+    ~GpuObject() { Reset(); }
+
+    GpuObject(GpuObject&& other) noexcept : mId(other.mId) { other.mId = 0; }
+
+    GpuObject& operator=(GpuObject&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            mId = other.mId;
+            other.mId = 0;
+        }
+        return *this;
+    }
+
+    // shaderType is only used for shaders
+    bool Create(const std::string& label, GLenum shaderType = 0)
+    {
+        Reset();
+        mId = Generate(shaderType);
+        if (mId == 0)
+        {
+            std::cout << "WARNING: Could not create " << GpuCategoryName(Category) << " '" << label << "'" << std::endl;
+            return false;
+        }
+        GpuResources().Add(Category, mId, label);
+        return true;
+    }
+
+    void SetSize(size_t bytes)
+    {
+        if (mId)
+            GpuResources().Resize(Category, mId, bytes);
+    }
+
+    void Reset()
+    {
+        if (mId == 0)
+            return;
+        GpuResources().Remove(Category, mId);
+        Delete(mId);
+        mId = 0;
+    }
+
+    GLuint Id() const { return mId; }
+    explicit operator bool() const { return mId != 0; }
+
+private:
+    GpuObject(const GpuObject&);
+    GpuObject& operator=(const GpuObject&);
+
+    static GLuint Generate(GLenum shaderType)
+    {
+        GLuint id = 0;
+        switch (Category)
+        {
+        case GpuCategory::Buffer: glGenBuffers(1, &id); break;
+        case GpuCategory::VertexArray: glGenVertexArrays(1, &id); break;
+        case GpuCategory::Texture: glGenTextures(1, &id); break;
+        case GpuCategory::Renderbuffer: glGenRenderbuffers(1, &id); break;
+        case GpuCategory::Framebuffer: glGenFramebuffers(1, &id); break;
+        case GpuCategory::Shader: id = glCreateShader(shaderType); break;
+        case GpuCategory::Program: id = glCreateProgram(); break;
+        default: break;
+        }
+        return id;
+    }
+
+    static void Delete(GLuint id)
+    {
+        switch (Category)
+        {
+        case GpuCategory::Buffer: glDeleteBuffers(1, &id); break;
+        case GpuCategory::VertexArray: glDeleteVertexArrays(1, &id); break;
+        case GpuCategory::Texture: glDeleteTextures(1, &id); break;
+        case GpuCategory::Renderbuffer: glDeleteRenderbuffers(1, &id); break;
+        case GpuCategory::Framebuffer: glDeleteFramebuffers(1, &id); break;
+        case GpuCategory::Shader: glDeleteShader(id); break;
+        case GpuCategory::Program: glDeleteProgram(id); break;
+        default: break;
+        }
+    }
+
+    GLuint mId;
+};
+
+typedef GpuObject<GpuCategory::Buffer> GpuBuffer;
+typedef GpuObject<GpuCategory::VertexArray> GpuVertexArray;
+typedef GpuObject<GpuCategory::Texture> GpuTexture;
+typedef GpuObject<GpuCategory::Renderbuffer> GpuRenderbuffer;
+typedef GpuObject<GpuCategory::Framebuffer> GpuFramebuffer;
+typedef GpuObject<GpuCategory::Shader> GpuShader;
+typedef GpuObject<GpuCategory::Program> GpuProgram;
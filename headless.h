@@ -0,0 +1,193 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "gpu_resources.h"
+
+// An OpenGL 4.4 core context with no window and no display server, for
+// build and CI machines. Uses EGL on Mesa: a surfaceless context when
+// EGL_KHR_surfaceless_context is available (llvmpipe has it), a 1x1 pbuffer
+// otherwise. Everything is drawn into an OffscreenTarget.
+class HeadlessContext
+{
+public:
+    HeadlessContext()
+#ifdef __linux__
+        : mDisplay(EGL_NO_DISPLAY), mContext(EGL_NO_CONTEXT), mSurface(EGL_NO_SURFACE)
+#endif
+    {
+    }
+
+    bool Create()
+    {
+#ifdef __linux__
+        // prefer Mesa's surfaceless platform, it needs neither X11 nor a GPU
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            mDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (mDisplay == EGL_NO_DISPLAY)
+            mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint major = 0, minor = 0;
+        if (mDisplay == EGL_NO_DISPLAY || !eglInitialize(mDisplay, &major, &minor))
+        {
+            std::cout << "Failed to initialize EGL" << std::endl;
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API))
+        {
+            std::cout << "Failed to bind the desktop OpenGL API" << std::endl;
+            return false;
+        }
+
+        const char* extensions = eglQueryString(mDisplay, EGL_EXTENSIONS);
+        const bool surfaceless = extensions && std::string(extensions).find("EGL_KHR_surfaceless_context") != std::string::npos;
+
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint nConfigs = 0;
+        if (!eglChooseConfig(mDisplay, configAttribs, &config, 1, &nConfigs) || nConfigs == 0)
+        {
+            std::cout << "Failed to find an EGL config" << std::endl;
+            return false;
+        }
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 4,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        mContext = eglCreateContext(mDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+        if (mContext == EGL_NO_CONTEXT)
+        {
+            std::cout << "Failed to create an OpenGL 4.4 core EGL context" << std::endl;
+            return false;
+        }
+
+        if (!surfaceless)
+        {
+            const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+            mSurface = eglCreatePbufferSurface(mDisplay, config, pbufferAttribs);
+        }
+        if (!eglMakeCurrent(mDisplay, mSurface, mSurface, mContext))
+        {
+            std::cout << "Failed to make the EGL context current" << std::endl;
+            return false;
+        }
+
+        std::cout << "INFO: EGL " << major << "." << minor << (surfaceless ? " surfaceless" : " pbuffer")
+            << " context" << std::endl;
+        return true;
+#else
+        std::cout << "Headless mode needs EGL, which this platform build does not have" << std::endl;
+        return false;
+#endif
+    }
+
+    void Destroy()
+    {
+#ifdef __linux__
+        if (mDisplay == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (mSurface != EGL_NO_SURFACE)
+            eglDestroySurface(mDisplay, mSurface);
+        if (mContext != EGL_NO_CONTEXT)
+            eglDestroyContext(mDisplay, mContext);
+        eglTerminate(mDisplay);
+        mDisplay = EGL_NO_DISPLAY;
+        mContext = EGL_NO_CONTEXT;
+        mSurface = EGL_NO_SURFACE;
+#endif
+    }
+
+private:
+#ifdef __linux__
+    EGLDisplay mDisplay;
+    EGLContext mContext;
+    EGLSurface mSurface;
+#endif
+};
+
+// Colour + depth framebuffer the headless mode renders into, with read-back
+// of the colour attachment as tightly packed RGBA8 rows, bottom row first
+class OffscreenTarget
+{
+public:
+    OffscreenTarget() : mWidth(0), mHeight(0) {}
+
+    bool Create(int width, int height)
+    {
+        mWidth = width;
+        mHeight = height;
+
+        mColor.Create("offscreen color");
+        glBindRenderbuffer(GL_RENDERBUFFER, mColor.Id());
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        mColor.SetSize((size_t)width * height * 4);
+
+        // depth24 is padded to 32 bits by every driver around
+        mDepth.Create("offscreen depth");
+        glBindRenderbuffer(GL_RENDERBUFFER, mDepth.Id());
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        mDepth.SetSize((size_t)width * height * 4);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        mFbo.Create("offscreen");
+        glBindFramebuffer(GL_FRAMEBUFFER, mFbo.Id());
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColor.Id());
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepth.Id());
+
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "Offscreen framebuffer incomplete: 0x" << std::hex << status << std::dec << std::endl;
+            return false;
+        }
+
+        // stays bound: every frame in headless mode goes here
+        glViewport(0, 0, width, height);
+        return true;
+    }
+
+    void ReadPixels(std::vector<unsigned char>& pixels) const
+    {
+        pixels.resize((size_t)mWidth * mHeight * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, mFbo.Id());
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    }
+
+    void Destroy()
+    {
+        mFbo.Reset();
+        mColor.Reset();
+        mDepth.Reset();
+    }
+
+    int Width() const { return mWidth; }
+    int Height() const { return mHeight; }
+
+private:
+    GpuFramebuffer mFbo;
+    GpuRenderbuffer mColor;
+    GpuRenderbuffer mDepth;
+    int mWidth;
+    int mHeight;
+};
@@ -0,0 +1,462 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGE_OPS_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__) || defined(__AVX__)
+#define IMAGE_OPS_SSSE3 1
+#include <tmmintrin.h>
+#endif
+// AVX2 is not assumed at build time: its kernels are compiled for it on
+// their own and only run when the CPU reports it (see HasAVX2)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGE_OPS_AVX2 1
+#define IMAGE_OPS_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define IMAGE_OPS_AVX2 1
+#define IMAGE_OPS_TARGET_AVX2
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+// Pixel kernels for getting decoded images ready for upload: row flip,
+// 1 / 2 / 3 channel -> RGBA8 expansion, premultiplied alpha and 2x2 box
+// filter mip generation. Each kernel has a scalar reference version that
+// produces bit-identical output. Every kernel has an AVX2 path, picked at
+// run time when the CPU has it; after that (or without it) SSE2 (SSSE3 for
+// RGB expansion) handles what is left when the compiler targets them, and
+// the scalar code the rest. Whole-image functions split their rows across
+// threads once an image passes PARALLEL_PIXELS.
+namespace image_ops
+{
+    const size_t PARALLEL_PIXELS = 1 << 20;
+
+    // Runs fn(begin, end) over [0, rows) in contiguous chunks. threads: 0 =
+    // one per hardware thread when pixels is large enough, 1 = inline.
+    inline void ParallelRows(int rows, size_t pixels, int threads, const std::function<void(int, int)>& fn)
+    {
+        if (threads == 0)
+            threads = pixels >= PARALLEL_PIXELS ? (int)std::max(1u, std::thread::hardware_concurrency()) : 1;
+        threads = std::max(1, std::min(threads, rows));
+        if (threads == 1)
+        {
+            fn(0, rows);
+            return;
+        }
+
+        std::vector<std::thread> workers;
+        const int chunk = (rows + threads - 1) / threads;
+        for (int begin = chunk; begin < rows; begin += chunk)
+            workers.push_back(std::thread(fn, begin, std::min(rows, begin + chunk)));
+        fn(0, std::min(rows, chunk));
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+    }
+
+    // Straightforward per-pixel versions, kept as the correctness and speed baseline
+    namespace reference
+    {
+        // The original flipImageVertically loop: one byte at a time
+        inline void FlipRows(uint8_t* image, int width, int height, int bytesPerPixel)
+        {
+            for (int j = 0; j < height / 2; ++j)
+            {
+                size_t index1 = (size_t)j * width * bytesPerPixel;
+                size_t index2 = (size_t)(height - 1 - j) * width * bytesPerPixel;
+                for (int i = width * bytesPerPixel; i > 0; --i)
+                {
+                    uint8_t tmp = image[index1];
+                    image[index1] = image[index2];
+                    image[index2] = tmp;
+                    ++index1;
+                    ++index2;
+                }
+            }
+        }
+
+        inline void ExpandToRGBA(const uint8_t* src, uint8_t* dst, size_t pixels, int channels)
+        {
+            for (size_t i = 0; i < pixels; ++i)
+            {
+                const uint8_t* s = src + i * channels;
+                uint8_t* d = dst + i * 4;
+                switch (channels)
+                {
+                case 1: d[0] = d[1] = d[2] = s[0]; d[3] = 255; break;
+                case 2: d[0] = d[1] = d[2] = s[0]; d[3] = s[1]; break;
+                case 3: d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; d[3] = 255; break;
+                default: d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; d[3] = s[3]; break;
+                }
+            }
+        }
+
+        // x * a / 255, rounded
+        inline uint8_t MulDiv255(int x, int a)
+        {
+            int t = x * a + 128;
+            return (uint8_t)((t + (t >> 8)) >> 8);
+        }
+
+        inline void PremultiplyAlpha(uint8_t* rgba, size_t pixels)
+        {
+            for (size_t i = 0; i < pixels; ++i)
+            {
+                uint8_t* p = rgba + i * 4;
+                p[0] = MulDiv255(p[0], p[3]);
+                p[1] = MulDiv255(p[1], p[3]);
+                p[2] = MulDiv255(p[2], p[3]);
+            }
+        }
+
+        // Rounded average of the two rows, then of the two columns, the
+        // same order and rounding as the SIMD pavgb path
+        inline void DownsampleRows(const uint8_t* src, int width, int height, uint8_t* dst, int begin, int end)
+        {
+            const int outWidth = std::max(1, width / 2);
+            for (int y = begin; y < end; ++y)
+            {
+                const uint8_t* row0 = src + (size_t)std::min(y * 2, height - 1) * width * 4;
+                const uint8_t* row1 = src + (size_t)std::min(y * 2 + 1, height - 1) * width * 4;
+                uint8_t* out = dst + (size_t)y * outWidth * 4;
+                for (int x = 0; x < outWidth; ++x)
+                {
+                    int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        int left = (row0[x0 * 4 + c] + row1[x0 * 4 + c] + 1) >> 1;
+                        int right = (row0[x1 * 4 + c] + row1[x1 * 4 + c] + 1) >> 1;
+                        out[x * 4 + c] = (uint8_t)((left + right + 1) >> 1);
+                    }
+                }
+            }
+        }
+
+        inline void Downsample(const uint8_t* src, int width, int height, uint8_t* dst)
+        {
+            DownsampleRows(src, width, height, dst, 0, std::max(1, height / 2));
+        }
+    }
+
+    // True when the CPU and OS support AVX2; checked once
+    inline bool HasAVX2()
+    {
+#if IMAGE_OPS_AVX2 && defined(__GNUC__)
+        static const bool avx2 = __builtin_cpu_supports("avx2") != 0;
+        return avx2;
+#elif IMAGE_OPS_AVX2
+        static const bool avx2 = []
+        {
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7)
+                return false;
+            // the OS must save the ymm registers too
+            __cpuid(info, 1);
+            if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6)
+                return false;
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+        }();
+        return avx2;
+#else
+        return false;
+#endif
+    }
+
+#if IMAGE_OPS_AVX2
+    // Swaps the leading whole 32 byte blocks of two rows, returns the bytes done
+    IMAGE_OPS_TARGET_AVX2 inline size_t SwapRowsAVX2(uint8_t* a, uint8_t* b, size_t bytes)
+    {
+        size_t i = 0;
+        for (; i + 32 <= bytes; i += 32)
+        {
+            __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+            __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+            _mm256_storeu_si256((__m256i*)(a + i), vb);
+            _mm256_storeu_si256((__m256i*)(b + i), va);
+        }
+        return i;
+    }
+
+    // Leading multiple of 8 pixels (10 for RGB, whose loads read ahead) of
+    // ExpandToRGBA, returns the pixels done
+    IMAGE_OPS_TARGET_AVX2 inline size_t ExpandToRGBAAVX2(const uint8_t* src, uint8_t* dst, size_t pixels, int channels)
+    {
+        size_t i = 0;
+        const __m256i opaque = _mm256_set1_epi32((int)0xFF000000);
+        if (channels == 1)
+        {
+            // each pixel widened to 32 bits, then the grey byte copied into r, g and b
+            const __m256i spread = _mm256_setr_epi8(0, 0, 0, -1, 4, 4, 4, -1, 8, 8, 8, -1, 12, 12, 12, -1,
+                0, 0, 0, -1, 4, 4, 4, -1, 8, 8, 8, -1, 12, 12, 12, -1);
+            for (; i + 8 <= pixels; i += 8)
+            {
+                __m256i grey = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+                _mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(grey, spread), opaque));
+            }
+        }
+        else if (channels == 2)
+        {
+            const __m256i spread = _mm256_setr_epi8(0, 0, 0, 1, 4, 4, 4, 5, 8, 8, 8, 9, 12, 12, 12, 13,
+                0, 0, 0, 1, 4, 4, 4, 5, 8, 8, 8, 9, 12, 12, 12, 13);
+            for (; i + 8 <= pixels; i += 8)
+            {
+                __m256i greyAlpha = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i * 2)));
+                _mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_shuffle_epi8(greyAlpha, spread));
+            }
+        }
+        else if (channels == 3)
+        {
+            // 4 pixels per 128-bit lane, the same shuffle as the SSSE3 path
+            const __m256i spread = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+            for (; i + 10 <= pixels; i += 8)
+            {
+                __m256i rgb = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src + i * 3))),
+                    _mm_loadu_si128((const __m128i*)(src + i * 3 + 12)), 1);
+                _mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(rgb, spread), opaque));
+            }
+        }
+        return i;
+    }
+
+    // Leading multiple of 8 pixels of PremultiplyAlpha, returns the pixels done
+    IMAGE_OPS_TARGET_AVX2 inline size_t PremultiplyAlphaAVX2(uint8_t* rgba, size_t pixels)
+    {
+        size_t i = 0;
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i half = _mm256_set1_epi16(128);
+        const __m256i alphaMask = _mm256_set1_epi32((int)0xFF000000);
+        for (; i + 8 <= pixels; i += 8)
+        {
+            // all lane-local, so unpack / pack keep the pixel order
+            __m256i v = _mm256_loadu_si256((const __m256i*)(rgba + i * 4));
+            __m256i lo = _mm256_unpacklo_epi8(v, zero);
+            __m256i hi = _mm256_unpackhi_epi8(v, zero);
+            __m256i alphaLo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, 0xFF), 0xFF);
+            __m256i alphaHi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, 0xFF), 0xFF);
+
+            __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(lo, alphaLo), half);
+            lo = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+            t = _mm256_add_epi16(_mm256_mullo_epi16(hi, alphaHi), half);
+            hi = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+
+            __m256i result = _mm256_packus_epi16(lo, hi);
+            result = _mm256_or_si256(_mm256_andnot_si256(alphaMask, result), _mm256_and_si256(alphaMask, v));
+            _mm256_storeu_si256((__m256i*)(rgba + i * 4), result);
+        }
+        return i;
+    }
+
+    // Leading multiple of 8 output pixels of one Downsample row, returns the pixels done
+    IMAGE_OPS_TARGET_AVX2 inline int DownsampleRowAVX2(const uint8_t* row0, const uint8_t* row1, uint8_t* out, int outWidth)
+    {
+        int x = 0;
+        for (; x + 8 <= outWidth; x += 8)
+        {
+            __m256i v0 = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i*)(row0 + x * 8)), _mm256_loadu_si256((const __m256i*)(row1 + x * 8)));
+            __m256i v1 = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i*)(row0 + x * 8 + 32)), _mm256_loadu_si256((const __m256i*)(row1 + x * 8 + 32)));
+            __m256i even = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(v0), _mm256_castsi256_ps(v1), _MM_SHUFFLE(2, 0, 2, 0)));
+            __m256i odd = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(v0), _mm256_castsi256_ps(v1), _MM_SHUFFLE(3, 1, 3, 1)));
+            // the shuffles work per lane: put the four pairs of pixels back in order
+            __m256i average = _mm256_permute4x64_epi64(_mm256_avg_epu8(even, odd), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256((__m256i*)(out + x * 4), average);
+        }
+        return x;
+    }
+#endif
+
+    // Swaps two rows of the same length
+    inline void SwapRows(uint8_t* a, uint8_t* b, size_t bytes)
+    {
+        size_t i = 0;
+#if IMAGE_OPS_AVX2
+        if (HasAVX2())
+            i = SwapRowsAVX2(a, b, bytes);
+#endif
+#if IMAGE_OPS_SSE2
+        for (; i + 16 <= bytes; i += 16)
+        {
+            __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+            _mm_storeu_si128((__m128i*)(a + i), vb);
+            _mm_storeu_si128((__m128i*)(b + i), va);
+        }
+#endif
+        for (; i < bytes; ++i)
+            std::swap(a[i], b[i]);
+    }
+
+    // Turns the image upside down in place
+    inline void FlipRows(uint8_t* image, int width, int height, int bytesPerPixel, int threads = 0)
+    {
+        const size_t row = (size_t)width * bytesPerPixel;
+        ParallelRows(height / 2, (size_t)width * height, threads, [=](int begin, int end)
+        {
+            for (int j = begin; j < end; ++j)
+                SwapRows(image + j * row, image + (height - 1 - j) * row, row);
+        });
+    }
+
+    // One run of pixels with 1 (grey), 2 (grey + alpha), 3 (RGB) or 4
+    // channels to RGBA8. src and dst must not overlap.
+    inline void ExpandToRGBA(const uint8_t* src, uint8_t* dst, size_t pixels, int channels)
+    {
+        size_t i = 0;
+#if IMAGE_OPS_AVX2
+        if (channels != 4 && HasAVX2())
+            i = ExpandToRGBAAVX2(src, dst, pixels, channels);
+#endif
+#if IMAGE_OPS_SSE2
+        if (channels == 1)
+        {
+            const __m128i opaque = _mm_set1_epi8((char)0xFF);
+            for (; i + 16 <= pixels; i += 16)
+            {
+                __m128i grey = _mm_loadu_si128((const __m128i*)(src + i));
+                __m128i gg0 = _mm_unpacklo_epi8(grey, grey), gg1 = _mm_unpackhi_epi8(grey, grey);
+                __m128i ga0 = _mm_unpacklo_epi8(grey, opaque), ga1 = _mm_unpackhi_epi8(grey, opaque);
+                _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_unpacklo_epi16(gg0, ga0));
+                _mm_storeu_si128((__m128i*)(dst + i * 4 + 16), _mm_unpackhi_epi16(gg0, ga0));
+                _mm_storeu_si128((__m128i*)(dst + i * 4 + 32), _mm_unpacklo_epi16(gg1, ga1));
+                _mm_storeu_si128((__m128i*)(dst + i * 4 + 48), _mm_unpackhi_epi16(gg1, ga1));
+            }
+        }
+        else if (channels == 2)
+        {
+            const __m128i lowByte = _mm_set1_epi16(0x00FF);
+            for (; i + 8 <= pixels; i += 8)
+            {
+                __m128i greyAlpha = _mm_loadu_si128((const __m128i*)(src + i * 2));
+                __m128i grey = _mm_and_si128(greyAlpha, lowByte);
+                __m128i gg = _mm_or_si128(grey, _mm_slli_epi16(grey, 8));
+                _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_unpacklo_epi16(gg, greyAlpha));
+                _mm_storeu_si128((__m128i*)(dst + i * 4 + 16), _mm_unpackhi_epi16(gg, greyAlpha));
+            }
+        }
+#endif
+#if IMAGE_OPS_SSSE3
+        if (channels == 3)
+        {
+            const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+            const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+            // each load reads 16 bytes for 4 pixels (12 bytes), so stop 2 pixels early
+            for (; i + 6 <= pixels; i += 4)
+            {
+                __m128i rgb = _mm_loadu_si128((const __m128i*)(src + i * 3));
+                _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(rgb, spread), opaque));
+            }
+        }
+#endif
+        if (channels == 4 && i == 0)
+        {
+            memcpy(dst, src, pixels * 4);
+            return;
+        }
+        reference::ExpandToRGBA(src + i * channels, dst + i * 4, pixels - i, channels);
+    }
+
+    inline void PremultiplyAlpha(uint8_t* rgba, size_t pixels)
+    {
+        size_t i = 0;
+#if IMAGE_OPS_AVX2
+        if (HasAVX2())
+            i = PremultiplyAlphaAVX2(rgba, pixels);
+#endif
+#if IMAGE_OPS_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i half = _mm_set1_epi16(128);
+        const __m128i alphaMask = _mm_set1_epi32((int)0xFF000000);
+        for (; i + 4 <= pixels; i += 4)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(rgba + i * 4));
+            __m128i lo = _mm_unpacklo_epi8(v, zero);
+            __m128i hi = _mm_unpackhi_epi8(v, zero);
+            __m128i alphaLo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xFF), 0xFF);
+            __m128i alphaHi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xFF), 0xFF);
+
+            __m128i t = _mm_add_epi16(_mm_mullo_epi16(lo, alphaLo), half);
+            lo = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+            t = _mm_add_epi16(_mm_mullo_epi16(hi, alphaHi), half);
+            hi = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+
+            __m128i result = _mm_packus_epi16(lo, hi);
+            result = _mm_or_si128(_mm_andnot_si128(alphaMask, result), _mm_and_si128(alphaMask, v));
+            _mm_storeu_si128((__m128i*)(rgba + i * 4), result);
+        }
+#endif
+        reference::PremultiplyAlpha(rgba + i * 4, pixels - i);
+    }
+
+    // One RGBA8 mip level from the previous one: dst is max(1, w/2) x max(1, h/2)
+    inline void Downsample(const uint8_t* src, int width, int height, uint8_t* dst, int threads = 0)
+    {
+        const int outWidth = std::max(1, width / 2), outHeight = std::max(1, height / 2);
+        ParallelRows(outHeight, (size_t)width * height, threads, [=](int begin, int end)
+        {
+#if IMAGE_OPS_SSE2
+            if (width >= 2)
+            {
+#if IMAGE_OPS_AVX2
+                const bool avx2 = HasAVX2();
+#endif
+                for (int y = begin; y < end; ++y)
+                {
+                    const uint8_t* row0 = src + (size_t)std::min(y * 2, height - 1) * width * 4;
+                    const uint8_t* row1 = src + (size_t)std::min(y * 2 + 1, height - 1) * width * 4;
+                    uint8_t* out = dst + (size_t)y * outWidth * 4;
+
+                    int x = 0;
+#if IMAGE_OPS_AVX2
+                    if (avx2)
+                        x = DownsampleRowAVX2(row0, row1, out, outWidth);
+#endif
+                    for (; x + 4 <= outWidth; x += 4)
+                    {
+                        __m128i v0 = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(row0 + x * 8)), _mm_loadu_si128((const __m128i*)(row1 + x * 8)));
+                        __m128i v1 = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(row0 + x * 8 + 16)), _mm_loadu_si128((const __m128i*)(row1 + x * 8 + 16)));
+                        __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(v0), _mm_castsi128_ps(v1), _MM_SHUFFLE(2, 0, 2, 0)));
+                        __m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(v0), _mm_castsi128_ps(v1), _MM_SHUFFLE(3, 1, 3, 1)));
+                        _mm_storeu_si128((__m128i*)(out + x * 4), _mm_avg_epu8(even, odd));
+                    }
+                    for (; x < outWidth; ++x)
+                    {
+                        for (int c = 0; c < 4; ++c)
+                        {
+                            int left = (row0[x * 8 + c] + row1[x * 8 + c] + 1) >> 1;
+                            int right = (row0[x * 8 + 4 + c] + row1[x * 8 + 4 + c] + 1) >> 1;
+                            out[x * 4 + c] = (uint8_t)((left + right + 1) >> 1);
+                        }
+                    }
+                }
+                return;
+            }
+#endif
+            reference::DownsampleRows(src, width, height, dst, begin, end);
+        });
+    }
+
+    // Decoded image (any of 1-4 channels, top row first) to RGBA8 with the
+    // bottom row first, ready for glTexImage2D at the default unpack
+    // alignment. Expansion and flip happen in the same pass.
+    inline std::vector<uint8_t> ToRGBA(const uint8_t* src, int width, int height, int channels, int threads = 0)
+    {
+        std::vector<uint8_t> rgba((size_t)width * height * 4);
+        uint8_t* dst = rgba.data();
+        ParallelRows(height, (size_t)width * height, threads, [=](int begin, int end)
+        {
+            for (int y = begin; y < end; ++y)
+                ExpandToRGBA(src + (size_t)(height - 1 - y) * width * channels, dst + (size_t)y * width * 4, width, channels);
+        });
+        return rgba;
+    }
+}
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "gpu_resources.h"
+
+// One light as the shaders read it (std430, vec4 members only). radius 0
+// means unbounded: no falloff, lights every fragment, like the original key
+// and fill lights. Bounded lights fade to nothing at radius.
+struct PointLight
+{
+    glm::vec4 positionRadius;       // world xyz, radius
+    glm::vec4 colorAmbient;         // rgb, ambient strength
+    glm::vec4 specular;             // intensity, highlight size, unused, unused
+
+    static PointLight Make(const glm::vec3& position, float radius, const glm::vec3& color,
+        float ambient, float specularIntensity, float highlightSize)
+    {
+        PointLight light;
+        light.positionRadius = glm::vec4(position, radius);
+        light.colorAmbient = glm::vec4(color, ambient);
+        light.specular = glm::vec4(specularIntensity, highlightSize, 0.0f, 0.0f);
+        return light;
+    }
+};
+
+// What the last Assign() produced
+struct ClusterStats
+{
+    int lights;             // total, unbounded included
+    int globalLights;       // unbounded, shaded everywhere without a cluster lookup
+    int references;         // light indices written over all clusters
+    int occupied;           // clusters with at least one bounded light
+    int maxPerCluster;
+};
+
+// Clustered light assignment on the CPU. The view frustum is cut into
+// TILES_X x TILES_Y screen tiles and SLICES depth slices (logarithmic for
+// perspective, linear for ortho). Every frame each bounded light's view
+// space sphere is tested against the clusters it can reach and the result
+// goes to three shader storage buffers: the lights, an (offset, count) pair
+// per cluster, and the packed light indices the pairs point into. The
+// fragment shader finds its cluster from gl_FragCoord and view depth and
+// only loops over that cluster's lights, plus the unbounded ones.
+//
+// Unbounded lights must come first in the list; they are never written to
+// the clusters.
+class LightClusters
+{
+public:
+    static const int TILES_X = 16;
+    static const int TILES_Y = 9;
+    static const int SLICES = 24;
+    static const int CLUSTERS = TILES_X * TILES_Y * SLICES;
+
+    LightClusters() : mLightsCapacity(0), mGridCapacity(0), mIndexCapacity(0), mLogarithmic(true)
+    {
+        mStats = ClusterStats();
+        mSliceParams = glm::vec4(0.0f);
+    }
+
+    void Init(GLuint lightsBinding, GLuint gridBinding, GLuint indexBinding)
+    {
+        mLightsBinding = lightsBinding;
+        mGridBinding = gridBinding;
+        mIndexBinding = indexBinding;
+        mLightsBuffer.Create("lights");
+        mGridBuffer.Create("light clusters");
+        mIndexBuffer.Create("light indices");
+        mGrid.resize(CLUSTERS * 2);
+    }
+
+    void Assign(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection)
+    {
+        BuildSlices(projection);
+
+        mStats = ClusterStats();
+        mStats.lights = (int)lights.size();
+        while (mStats.globalLights < mStats.lights && lights[mStats.globalLights].positionRadius.w <= 0.0f)
+            ++mStats.globalLights;
+
+        // (cluster, light) pairs, counting-sorted into the grid below
+        mCounts.assign(CLUSTERS, 0);
+        mPairs.clear();
+        for (int i = mStats.globalLights; i < mStats.lights; ++i)
+        {
+            const float radius = lights[i].positionRadius.w;
+            if (radius <= 0.0f)
+                continue;
+            const glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(lights[i].positionRadius), 1.0f));
+            const float depth = -center.z;
+
+            for (int z = 0; z < SLICES; ++z)
+            {
+                const float dz = Distance(depth, mSliceNear[z], mSliceFar[z]);
+                if (dz > radius)
+                    continue;
+                for (int y = 0; y < TILES_Y; ++y)
+                {
+                    const float dy = Distance(center.y, mRowMin[z][y], mRowMax[z][y]);
+                    if (dz * dz + dy * dy > radius * radius)
+                        continue;
+                    for (int x = 0; x < TILES_X; ++x)
+                    {
+                        const float dx = Distance(center.x, mColumnMin[z][x], mColumnMax[z][x]);
+                        if (dx * dx + dy * dy + dz * dz > radius * radius)
+                            continue;
+                        const uint32_t cluster = (uint32_t)((z * TILES_Y + y) * TILES_X + x);
+                        ++mCounts[cluster];
+                        mPairs.push_back(cluster);
+                        mPairs.push_back((uint32_t)i);
+                    }
+                }
+            }
+        }
+
+        uint32_t offset = 0;
+        for (int c = 0; c < CLUSTERS; ++c)
+        {
+            mGrid[c * 2] = offset;
+            mGrid[c * 2 + 1] = 0;
+            offset += mCounts[c];
+            mStats.occupied += mCounts[c] ? 1 : 0;
+            mStats.maxPerCluster = std::max(mStats.maxPerCluster, (int)mCounts[c]);
+        }
+        mIndices.resize(std::max<size_t>(offset, 1));
+        for (size_t p = 0; p < mPairs.size(); p += 2)
+        {
+            uint32_t* entry = &mGrid[mPairs[p] * 2];
+            mIndices[entry[0] + entry[1]++] = mPairs[p + 1];
+        }
+        mStats.references = (int)offset;
+
+        Upload(mLightsBuffer, mLightsBinding, lights.data(), lights.size() * sizeof(PointLight), mLightsCapacity);
+        Upload(mGridBuffer, mGridBinding, mGrid.data(), mGrid.size() * sizeof(uint32_t), mGridCapacity);
+        Upload(mIndexBuffer, mIndexBinding, mIndices.data(), mIndices.size() * sizeof(uint32_t), mIndexCapacity);
+    }
+
+    // For the shader: slice = floor(d * x + y) with d = log(view depth) when
+    // z is 1, the view depth itself when z is 0
+    const glm::vec4& SliceParams() const { return mSliceParams; }
+
+    const ClusterStats& Stats() const { return mStats; }
+
+    void Release()
+    {
+        mLightsBuffer.Reset();
+        mGridBuffer.Reset();
+        mIndexBuffer.Reset();
+        mLightsCapacity = mGridCapacity = mIndexCapacity = 0;
+    }
+
+private:
+    // Distance from v to the range [lo, hi], 0 inside it
+    static float Distance(float v, float lo, float hi)
+    {
+        return v < lo ? lo - v : (v > hi ? v - hi : 0.0f);
+    }
+
+    // Slice depths and, per slice, the view space x range of every tile
+    // column and y range of every tile row (a cluster's box is their
+    // product). Only redone when the projection changes.
+    void BuildSlices(const glm::mat4& projection)
+    {
+        if (projection == mProjection && mSliceParams != glm::vec4(0.0f))
+            return;
+        mProjection = projection;
+
+        // near / far back out of the matrix; perspective has w = -z
+        mLogarithmic = projection[2][3] != 0.0f;
+        float zNear, zFar;
+        if (mLogarithmic)
+        {
+            zNear = projection[3][2] / (projection[2][2] - 1.0f);
+            zFar = projection[3][2] / (projection[2][2] + 1.0f);
+            const float scale = SLICES / logf(zFar / zNear);
+            mSliceParams = glm::vec4(scale, -logf(zNear) * scale, 1.0f, 0.0f);
+        }
+        else
+        {
+            zNear = (projection[3][2] + 1.0f) / projection[2][2];
+            zFar = (projection[3][2] - 1.0f) / projection[2][2];
+            const float scale = SLICES / (zFar - zNear);
+            mSliceParams = glm::vec4(scale, -zNear * scale, 0.0f, 0.0f);
+        }
+
+        const glm::mat4 inverse = glm::inverse(projection);
+        for (int z = 0; z < SLICES; ++z)
+        {
+            mSliceNear[z] = SliceDepth(zNear, zFar, z);
+            mSliceFar[z] = SliceDepth(zNear, zFar, z + 1);
+            for (int x = 0; x < TILES_X; ++x)
+            {
+                const float left = -1.0f + 2.0f * x / TILES_X, right = -1.0f + 2.0f * (x + 1) / TILES_X;
+                Extent(inverse, glm::vec2(left, 0.0f), glm::vec2(right, 0.0f), z, 0, mColumnMin[z][x], mColumnMax[z][x]);
+            }
+            for (int y = 0; y < TILES_Y; ++y)
+            {
+                const float bottom = -1.0f + 2.0f * y / TILES_Y, top = -1.0f + 2.0f * (y + 1) / TILES_Y;
+                Extent(inverse, glm::vec2(0.0f, bottom), glm::vec2(0.0f, top), z, 1, mRowMin[z][y], mRowMax[z][y]);
+            }
+        }
+    }
+
+    float SliceDepth(float zNear, float zFar, int slice) const
+    {
+        const float t = (float)slice / SLICES;
+        return mLogarithmic ? zNear * powf(zFar / zNear, t) : zNear + (zFar - zNear) * t;
+    }
+
+    // Range of one view space axis over two NDC edges, each taken at both
+    // of the slice's depths
+    void Extent(const glm::mat4& inverse, const glm::vec2& a, const glm::vec2& b, int slice, int axis, float& lo, float& hi) const
+    {
+        const glm::vec2 edges[2] = { a, b };
+        const float depths[2] = { mSliceNear[slice], mSliceFar[slice] };
+        lo = 1e30f;
+        hi = -1e30f;
+        for (int e = 0; e < 2; ++e)
+        {
+            // the ray through the edge, between the near and far planes
+            glm::vec4 nearPoint = inverse * glm::vec4(edges[e].x, edges[e].y, -1.0f, 1.0f);
+            glm::vec4 farPoint = inverse * glm::vec4(edges[e].x, edges[e].y, 1.0f, 1.0f);
+            const glm::vec3 p0 = glm::vec3(nearPoint) / nearPoint.w, p1 = glm::vec3(farPoint) / farPoint.w;
+            for (int d = 0; d < 2; ++d)
+            {
+                const float t = (-depths[d] - p0.z) / (p1.z - p0.z);
+                const float v = p0[axis] + (p1[axis] - p0[axis]) * t;
+                lo = std::min(lo, v);
+                hi = std::max(hi, v);
+            }
+        }
+    }
+
+    // Grows with headroom, otherwise rewrites in place; never zero sized
+    static void Upload(GpuBuffer& buffer, GLuint binding, const void* data, size_t bytes, size_t& capacity)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer.Id());
+        if (bytes > capacity || capacity == 0)
+        {
+            capacity = std::max<size_t>(bytes + bytes / 2, 256);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, capacity, NULL, GL_DYNAMIC_DRAW);
+            buffer.SetSize(capacity);
+        }
+        if (bytes > 0)
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, data);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer.Id());
+    }
+
+    GpuBuffer mLightsBuffer;
+    GpuBuffer mGridBuffer;
+    GpuBuffer mIndexBuffer;
+    size_t mLightsCapacity;
+    size_t mGridCapacity;
+    size_t mIndexCapacity;
+    GLuint mLightsBinding;
+    GLuint mGridBinding;
+    GLuint mIndexBinding;
+
+    glm::mat4 mProjection;
+    bool mLogarithmic;
+    glm::vec4 mSliceParams;
+    float mSliceNear[SLICES];
+    float mSliceFar[SLICES];
+    float mColumnMin[SLICES][TILES_X];
+    float mColumnMax[SLICES][TILES_X];
+    float mRowMin[SLICES][TILES_Y];
+    float mRowMax[SLICES][TILES_Y];
+
+    std::vector<uint32_t> mCounts;
+    std::vector<uint32_t> mPairs;       // cluster, light, cluster, light, ...
+    std::vector<uint32_t> mGrid;        // offset, count per cluster
+    std::vector<uint32_t> mIndices;
+    ClusterStats mStats;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "frustum.h"
+#include "mesh_registry.h"
+
+// Objects drawn at each level by the last frame's Select() calls
+struct LodStats
+{
+    int objects[LodChain::MAX_LEVELS];
+};
+
+// Picks a level of a LodChain per object from how big it is on screen.
+// A level is good enough while one sector of its silhouette spans no more
+// than the pixel error (circumference in pixels / sectors), so a chain whose
+// levels halve their sectors switches every time the object halves in size.
+// Each object remembers its level and only moves to a coarser one once it
+// is HYSTERESIS below that level's limit, and back to a finer one once it
+// is HYSTERESIS above, so objects near a boundary do not pop every frame.
+class LodSelector
+{
+public:
+    static constexpr float HYSTERESIS = 0.15f;
+
+    LodSelector() : mPixelError(6.0f), mViewportHeight(1.0f), mEnabled(true)
+    {
+        mStats = LodStats();
+    }
+
+    // Largest silhouette sector length, in pixels, a level may show
+    void SetPixelError(float pixels) { mPixelError = std::max(pixels, 0.5f); }
+    // Off = every chain draws its finest level
+    void SetEnabled(bool enabled) { mEnabled = enabled; }
+    bool Enabled() const { return mEnabled; }
+
+    void Begin(const glm::mat4& view, const glm::mat4& projection, int viewportHeight)
+    {
+        mView = view;
+        mProjection = projection;
+        mViewportHeight = (float)viewportHeight;
+        mStats = LodStats();
+    }
+
+    // On-screen diameter in pixels of bounds placed by world; works for
+    // perspective (w = view depth) and ortho (w = 1) projections alike
+    float ProjectedDiameter(const MeshBounds& bounds, const glm::mat4& world) const
+    {
+        const glm::vec4 center = mView * (world * glm::vec4(bounds.center, 1.0f));
+        const float scale = std::max(glm::length(glm::vec3(world[0])),
+            std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+        const float radius = bounds.radius * scale;
+
+        const float w = mProjection[0][3] * center.x + mProjection[1][3] * center.y
+            + mProjection[2][3] * center.z + mProjection[3][3] * center.w;
+        // perspective only (ortho has w = 1 everywhere): camera inside or right
+        // next to the object, as big as it gets
+        if (mProjection[2][3] != 0.0f && w <= radius)
+            return mViewportHeight;
+        return radius * std::fabs(mProjection[1][1]) * mViewportHeight / w;
+    }
+
+    // Level of chain to draw object (any stable index, e.g. the node id) at
+    int Select(int object, const LodChain& chain, float diameter)
+    {
+        if (object >= (int)mLevels.size())
+            mLevels.resize(object + 1, 0);
+
+        int level = std::min((int)mLevels[object], chain.count - 1);
+        if (!mEnabled)
+            level = 0;
+        else
+        {
+            while (level + 1 < chain.count && diameter <= MaxDiameter(chain, level + 1) * (1.0f - HYSTERESIS))
+                ++level;
+            while (level > 0 && diameter > MaxDiameter(chain, level) * (1.0f + HYSTERESIS))
+                --level;
+        }
+
+        mLevels[object] = (uint8_t)level;
+        ++mStats.objects[level];
+        return level;
+    }
+
+    const LodStats& Stats() const { return mStats; }
+
+private:
+    // Largest diameter at which the level's sectors stay within the error
+    float MaxDiameter(const LodChain& chain, int level) const
+    {
+        return mPixelError * chain.sectors[level] / 3.14159265f;
+    }
+
+    glm::mat4 mView;
+    glm::mat4 mProjection;
+    float mPixelError;
+    float mViewportHeight;
+    bool mEnabled;
+    std::vector<uint8_t> mLevels;   // last level per object
+    LodStats mStats;
+};
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "bc_encoder.h"
+#include "gpu_resources.h"
+#include "stb_image.h"
+#include "texture_container.h"
+#include "texture_loader.h"
+
+// Handle returned by MaterialTextures::Add; index into its material table
+typedef int MaterialId;
+const MaterialId NO_MATERIAL = -1;
+
+// Where a material's image sits in the shared texture array. The shader wraps
+// the mesh UVs into uvRect (offset xy, scale zw, in layer UVs) and never
+// samples finer than maxLod, past which packed neighbours would bleed in.
+struct MaterialSlot
+{
+    glm::vec4 uvRect;
+    float layer;
+    float maxLod;
+};
+
+// Every material image in one GL_TEXTURE_2D_ARRAY, so the whole scene draws
+// with a single texture binding and materials never split a draw batch.
+//
+// Images that are all the same size get a layer each. Otherwise the layers
+// take the largest width and height, images that fill a layer still get one
+// to themselves, and the rest are shelf-packed into shared atlas layers with
+// a gutter between them. When every image has a cooked .tex of one format
+// and size the array uses that format and the stored levels go in as they
+// are; anything else is decoded to RGBA8 and mipmapped on the GPU.
+//
+// Contents stream in through the TextureLoader; until then every layer is
+// the loader's placeholder grey.
+class MaterialTextures
+{
+public:
+    static const GLint ATLAS_GUTTER = 8;    // texels between packed images; 8 keeps 3 clean mip levels
+
+    MaterialTextures() : mFormat(GL_RGBA8), mCookedFormat(0), mLayerWidth(0), mLayerHeight(0), mLayers(0), mLevels(0), mPacked(0) {}
+
+    // Registers an image for the array. Fails only when neither the image
+    // nor its .tex file exists.
+    bool Add(const std::string& filename, MaterialId& id)
+    {
+        if (!TextureLoader::FileExists(filename) && !TextureLoader::FileExists(TextureLoader::CookedName(filename)))
+            return false;
+
+        Material material;
+        material.filename = filename;
+        material.width = material.height = 0;
+        material.cookedFormat = 0;
+        material.cookedLevels = 0;
+        material.slot.uvRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+        material.slot.layer = 0.0f;
+        material.slot.maxLod = 0.0f;
+        id = (MaterialId)mMaterials.size();
+        mMaterials.push_back(material);
+        return true;
+    }
+
+    // Lays out every registered image, creates the array and queues the
+    // images on loader. Call once, after the last Add().
+    bool Build(TextureLoader& loader)
+    {
+        if (mMaterials.empty())
+            return true;
+
+        Probe();
+        const bool cooked = UniformCooked();
+        if (cooked)
+            LayOutCooked();
+        else
+            LayOutDecoded();
+
+        GLint maxLayers = 0;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        if (mLayers > maxLayers)
+        {
+            std::cout << "WARNING: Materials need " << mLayers << " array layers, the driver allows " << maxLayers << std::endl;
+            return false;
+        }
+
+        mTexture.Create("material array");
+        glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture.Id());
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, mLevels, mFormat, mLayerWidth, mLayerHeight, mLayers);
+        mTexture.SetSize(StorageBytes());
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, mLevels - 1);
+        FillPlaceholder();
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        for (size_t i = 0; i < mMaterials.size(); ++i)
+        {
+            Material& material = mMaterials[i];
+            if (material.width == 0)
+                continue;
+            material.target.texture = mTexture.Id();
+            material.target.cooked = cooked;
+            if (!loader.RequestLayer(material.filename, material.target))
+                std::cout << "WARNING: Could not queue material " << material.filename << std::endl;
+        }
+
+        std::cout << "INFO: " << mMaterials.size() << " materials in " << mLayers << " layers of " << mLayerWidth << "x" << mLayerHeight
+            << " (" << mPacked << " atlas packed, " << mLevels << " levels, " << (cooked ? "cooked" : "decoded") << ")" << std::endl;
+        return true;
+    }
+
+    const MaterialSlot& Get(MaterialId id) const { return mMaterials[id].slot; }
+    GLuint Texture() const { return mTexture.Id(); }
+    int Layers() const { return mLayers; }
+
+    void Release()
+    {
+        mTexture.Reset();
+        mMaterials.clear();
+        mLayers = mLevels = mPacked = 0;
+    }
+
+private:
+    struct Material
+    {
+        std::string filename;
+        int width, height;      // 0 when the image could not be read
+        uint32_t cookedFormat;  // 0 = no usable .tex
+        size_t cookedLevels;
+        TextureSlot target;     // where the loader puts it
+        MaterialSlot slot;      // what the shader gets
+    };
+
+    // Sizes from the .tex header or the image header, without decoding
+    void Probe()
+    {
+        for (size_t i = 0; i < mMaterials.size(); ++i)
+        {
+            Material& material = mMaterials[i];
+            const std::string cookedName = TextureLoader::CookedName(material.filename);
+            CookedTexture tex;
+            int channels = 0;
+            if (TextureLoader::FileExists(cookedName) && tex.Open(cookedName))
+            {
+                material.cookedFormat = tex.Format();
+                material.cookedLevels = tex.LevelCount();
+                material.width = (int)tex.Width();
+                material.height = (int)tex.Height();
+            }
+            else if (!stbi_info(material.filename.c_str(), &material.width, &material.height, &channels))
+            {
+                std::cout << "WARNING: Could not read the size of " << material.filename << ", it keeps the placeholder" << std::endl;
+                material.width = material.height = 0;
+            }
+        }
+    }
+
+    // Every image cooked to the same format, size and level count, in a
+    // format this driver takes and the placeholder can be written in
+    bool UniformCooked() const
+    {
+        const Material& first = mMaterials[0];
+        if (first.cookedFormat == 0 || first.cookedFormat == cooked::FORMAT_BC7)
+            return false;
+        if ((first.cookedFormat == cooked::FORMAT_BC1 || first.cookedFormat == cooked::FORMAT_BC3) && !GLEW_EXT_texture_compression_s3tc)
+            return false;
+        for (size_t i = 1; i < mMaterials.size(); ++i)
+        {
+            const Material& material = mMaterials[i];
+            if (material.cookedFormat != first.cookedFormat || material.width != first.width
+                || material.height != first.height || material.cookedLevels != first.cookedLevels)
+                return false;
+        }
+        return true;
+    }
+
+    void LayOutCooked()
+    {
+        mCookedFormat = mMaterials[0].cookedFormat;
+        mFormat = cooked::InternalFormat(mCookedFormat);
+        mLayerWidth = mMaterials[0].width;
+        mLayerHeight = mMaterials[0].height;
+        mLevels = (GLsizei)mMaterials[0].cookedLevels;
+        mLayers = 0;
+        for (size_t i = 0; i < mMaterials.size(); ++i)
+            Place(mMaterials[i], mLayers++, 0, 0, (float)(mLevels - 1));
+    }
+
+    void LayOutDecoded()
+    {
+        mCookedFormat = 0;
+        mFormat = GL_RGBA8;
+        mLayerWidth = mLayerHeight = 1;
+        std::vector<Material*> packed;
+        std::vector<Material*> failed;
+        for (size_t i = 0; i < mMaterials.size(); ++i)
+        {
+            Material& material = mMaterials[i];
+            if (material.cookedFormat != 0 && !TextureLoader::FileExists(material.filename))
+            {
+                // cooked in another format or size than the rest: only the source can be decoded into the array
+                std::cout << "WARNING: " << material.filename << " is needed to put its cooked texture in the material array" << std::endl;
+                material.width = material.height = 0;
+            }
+            mLayerWidth = std::max(mLayerWidth, material.width);
+            mLayerHeight = std::max(mLayerHeight, material.height);
+        }
+        mLevels = (GLsizei)std::floor(std::log2((double)std::max(mLayerWidth, mLayerHeight))) + 1;
+        const float fullLod = (float)(mLevels - 1);
+        const float packedLod = std::min(fullLod, std::log2((float)ATLAS_GUTTER));
+
+        // images that fill a layer keep it to themselves
+        mLayers = 0;
+        for (size_t i = 0; i < mMaterials.size(); ++i)
+        {
+            Material& material = mMaterials[i];
+            if (material.width == 0)
+                failed.push_back(&material);
+            else if (material.width == mLayerWidth && material.height == mLayerHeight)
+                Place(material, mLayers++, 0, 0, fullLod);
+            else
+                packed.push_back(&material);
+        }
+
+        // the rest go on shelves, tallest first
+        std::sort(packed.begin(), packed.end(), [](const Material* a, const Material* b) { return a->height > b->height; });
+        int layer = -1, x = 0, y = 0, shelf = 0;
+        for (size_t i = 0; i < packed.size(); ++i)
+        {
+            Material& material = *packed[i];
+            if (layer >= 0 && x + material.width > mLayerWidth)
+            {
+                x = 0;
+                y += shelf + ATLAS_GUTTER;
+                shelf = 0;
+            }
+            if (layer < 0 || y + material.height > mLayerHeight)
+            {
+                layer = mLayers++;
+                x = y = shelf = 0;
+            }
+            Place(material, layer, x, y, packedLod);
+            x += material.width + ATLAS_GUTTER;
+            shelf = std::max(shelf, material.height);
+        }
+        mPacked = (int)packed.size();
+
+        // unreadable images share one layer that stays placeholder grey
+        if (!failed.empty())
+        {
+            const int placeholder = mLayers++;
+            for (size_t i = 0; i < failed.size(); ++i)
+                Place(*failed[i], placeholder, 0, 0, fullLod);
+        }
+    }
+
+    void Place(Material& material, int layer, int x, int y, float maxLod)
+    {
+        const int width = material.width ? material.width : mLayerWidth;
+        const int height = material.height ? material.height : mLayerHeight;
+        TextureSlot target = { 0, layer, x, y, material.width, material.height, false };
+        material.target = target;
+        material.slot.uvRect = glm::vec4((float)x / mLayerWidth, (float)y / mLayerHeight,
+            (float)width / mLayerWidth, (float)height / mLayerHeight);
+        material.slot.layer = (float)layer;
+        material.slot.maxLod = maxLod;
+    }
+
+    // Grey in every level of every layer; compressed formats get one
+    // encoded grey block repeated
+    void FillPlaceholder()
+    {
+        const unsigned char grey[4] = { 128, 128, 128, 255 };
+        if (!cooked::IsCompressed(mCookedFormat))
+        {
+            for (GLint level = 0; level < mLevels; ++level)
+                glClearTexImage(mTexture.Id(), level, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+            return;
+        }
+
+        unsigned char pixels[16 * 4];
+        for (int i = 0; i < 16; ++i)
+            std::copy(grey, grey + 4, pixels + i * 4);
+        const bool alpha = mCookedFormat == cooked::FORMAT_BC3;
+        const std::vector<uint8_t> block = bc_encoder::EncodeImage(pixels, 4, 4, alpha);
+
+        std::vector<uint8_t> level;
+        for (GLint i = 0; i < mLevels; ++i)
+        {
+            const GLsizei width = std::max(1, mLayerWidth >> i), height = std::max(1, mLayerHeight >> i);
+            const size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4) * mLayers;
+            level.resize(blocks * block.size());
+            for (size_t b = 0; b < blocks; ++b)
+                std::copy(block.begin(), block.end(), level.begin() + b * block.size());
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, 0, width, height, mLayers, mFormat, (GLsizei)level.size(), level.data());
+        }
+    }
+
+    // Every level of every layer
+    size_t StorageBytes() const
+    {
+        const uint32_t format = mCookedFormat ? mCookedFormat : (uint32_t)cooked::FORMAT_RGBA8;
+        size_t bytes = 0;
+        for (GLint i = 0; i < mLevels; ++i)
+            bytes += (size_t)cooked::LevelSize(format, std::max(1, mLayerWidth >> i), std::max(1, mLayerHeight >> i));
+        return bytes * mLayers;
+    }
+
+    std::vector<Material> mMaterials;
+    GpuTexture mTexture;
+    GLenum mFormat;
+    uint32_t mCookedFormat;     // 0 when the images are decoded
+    GLint mLayerWidth, mLayerHeight;
+    GLint mLayers;
+    GLsizei mLevels;
+    int mPacked;            // images sharing a layer with others
+};
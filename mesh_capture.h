@@ -0,0 +1,140 @@
+#pragma once
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "gpu_resources.h"
+
+// Records the triangles a mesh class draws, for the tutorial classes that
+// build their own buffers and only expose a draw call (cyl.h, coaster.h,
+// SphereCite.h). The draw runs once through a pass-through vertex shader
+// with transform feedback on and the rasterizer off, so whatever strips and
+// fans it issues come back as a plain triangle soup in the registry's
+// layout: position(3) normal(3) uv(2), read from attribute locations 0 / 1
+// / 2 like the Phong shader always did.
+class MeshCapture
+{
+public:
+    static const int FLOATS_PER_VERTEX = 8;
+
+    MeshCapture() : mQuery(0) {}
+
+    // Needs a current context; false if the capture program does not link
+    bool Init()
+    {
+        static const char* source =
+            "#version 440 core\n"
+            "layout(location = 0) in vec3 position;\n"
+            "layout(location = 1) in vec3 normal;\n"
+            "layout(location = 2) in vec2 textureCoordinate;\n"
+            "out vec3 capturedPosition;\n"
+            "out vec3 capturedNormal;\n"
+            "out vec2 capturedUV;\n"
+            "void main()\n"
+            "{\n"
+            "    capturedPosition = position;\n"
+            "    capturedNormal = normal;\n"
+            "    capturedUV = textureCoordinate;\n"
+            "    gl_Position = vec4(position, 1.0f);\n"
+            "}\n";
+        static const char* varyings[] = { "capturedPosition", "capturedNormal", "capturedUV" };
+
+        GpuShader shader;
+        if (!shader.Create("mesh capture vertex", GL_VERTEX_SHADER) || !mProgram.Create("mesh capture"))
+            return false;
+        glShaderSource(shader.Id(), 1, &source, NULL);
+        glCompileShader(shader.Id());
+        glAttachShader(mProgram.Id(), shader.Id());
+        // interleaved, so the buffer already has the arena's vertex layout
+        glTransformFeedbackVaryings(mProgram.Id(), 3, varyings, GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(mProgram.Id());
+        glDetachShader(mProgram.Id(), shader.Id());
+
+        GLint linked = 0;
+        glGetProgramiv(mProgram.Id(), GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            char infoLog[512];
+            glGetProgramInfoLog(mProgram.Id(), sizeof(infoLog), NULL, infoLog);
+            std::cout << "WARNING: Mesh capture program did not link\n" << infoLog << std::endl;
+            mProgram.Reset();
+            return false;
+        }
+        glGenQueries(1, &mQuery);
+        return true;
+    }
+
+    bool Valid() const { return (bool)mProgram; }
+
+    // Runs draw (which may also build the mesh: a scratch VAO is bound
+    // first, as the old render code always had one bound) and returns every
+    // triangle it drew. Runs draw again if the first guess at the size was
+    // too small.
+    bool Capture(const char* label, const std::function<void()>& draw, std::vector<GLfloat>& soup)
+    {
+        soup.clear();
+        if (!mProgram)
+            return false;
+
+        size_t capacity = 1 << 16;    // in vertices
+        for (int attempt = 0; attempt < 2; ++attempt)
+        {
+            GpuBuffer buffer;
+            GpuVertexArray vao;
+            if (!buffer.Create(std::string(label) + " capture") || !vao.Create(std::string(label) + " capture"))
+                return false;
+            const size_t bytes = capacity * FLOATS_PER_VERTEX * sizeof(GLfloat);
+            glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, buffer.Id());
+            glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffer.Id());
+
+            glBindVertexArray(vao.Id());
+            glUseProgram(mProgram.Id());
+            glEnable(GL_RASTERIZER_DISCARD);
+            glBeginQuery(GL_PRIMITIVES_GENERATED, mQuery);
+            glBeginTransformFeedback(GL_TRIANGLES);
+            draw();
+            glEndTransformFeedback();
+            glEndQuery(GL_PRIMITIVES_GENERATED);
+            glDisable(GL_RASTERIZER_DISCARD);
+            glUseProgram(0);
+            glBindVertexArray(0);
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+
+            GLuint triangles = 0;
+            glGetQueryObjectuiv(mQuery, GL_QUERY_RESULT, &triangles);
+            const size_t vertices = (size_t)triangles * 3;
+            if (vertices > capacity)
+            {
+                capacity = vertices;
+                continue;
+            }
+
+            soup.resize(vertices * FLOATS_PER_VERTEX);
+            if (!soup.empty())
+                glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, soup.size() * sizeof(GLfloat), soup.data());
+            glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+            if (soup.empty())
+                std::cout << "WARNING: Mesh '" << label << "' drew no triangles to capture" << std::endl;
+            return !soup.empty();
+        }
+        std::cout << "WARNING: Mesh '" << label << "' drew a different amount on the second capture" << std::endl;
+        return false;
+    }
+
+    void Release()
+    {
+        mProgram.Reset();
+        if (mQuery)
+            glDeleteQueries(1, &mQuery);
+        mQuery = 0;
+    }
+
+private:
+    GpuProgram mProgram;
+    GLuint mQuery;      // GL_PRIMITIVES_GENERATED
+};
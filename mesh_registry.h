@@ -0,0 +1,285 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "tutorial_05_05/sphere.h"
+#include "tutorial_05_05/SphereCite.h"
+#include "tutorial_05_05/cyl.h"
+#include "tutorial_05_05/coaster.h"
+#include "frustum.h"
+#include "geometry_arena.h"
+#include "mesh_capture.h"
+#include "mesh_optimizer.h"
+
+// Procedural primitive types the scene knows how to build
+enum class PrimitiveType
+{
+    Sphere,     // Sphere from sphere.h (sectors x stacks, smooth or flat shaded)
+    Sphere2,    // Orb sphere from SphereCite.h
+    Cylinder,   // static_meshes_3D::Cylinder from cyl.h
+    Coaster     // static_meshes_3D::Coaster from coaster.h
+};
+
+// Everything that decides the shape of a primitive. Two keys that compare
+// equal produce identical geometry, so they share one GPU mesh.
+struct MeshKey
+{
+    PrimitiveType type;
+    float radius;
+    float height;   // only used by cylinders / coasters
+    int sectors;    // sectors for spheres, slices for cylinders
+    int stacks;     // only used by spheres
+    bool smooth;
+
+    static MeshKey MakeSphere(float radius, int sectors, int stacks, bool smooth = true)
+    {
+        return MeshKey{ PrimitiveType::Sphere, radius, 0.0f, sectors, stacks, smooth };
+    }
+    static MeshKey MakeSphere2(float radius, int sectors, int stacks)
+    {
+        return MeshKey{ PrimitiveType::Sphere2, radius, 0.0f, sectors, stacks, true };
+    }
+    static MeshKey MakeCylinder(float radius, int slices, float height)
+    {
+        return MeshKey{ PrimitiveType::Cylinder, radius, height, slices, 0, true };
+    }
+    static MeshKey MakeCoaster(float radius, int slices, float height)
+    {
+        return MeshKey{ PrimitiveType::Coaster, radius, height, slices, 0, true };
+    }
+
+    // Same primitive at roughly half the tessellation, never below
+    // LOD_MIN_SECTORS / LOD_MIN_STACKS (or the key's own counts if lower)
+    MeshKey Coarser() const
+    {
+        MeshKey coarser = *this;
+        coarser.sectors = std::min(sectors, std::max((int)LOD_MIN_SECTORS, sectors / 2));
+        if (type == PrimitiveType::Sphere || type == PrimitiveType::Sphere2)
+            coarser.stacks = std::min(stacks, std::max((int)LOD_MIN_STACKS, stacks / 2));
+        return coarser;
+    }
+
+    static const int LOD_MIN_SECTORS = 8;
+    static const int LOD_MIN_STACKS = 4;
+
+    bool operator<(const MeshKey& other) const
+    {
+        if (type != other.type) return type < other.type;
+        if (radius != other.radius) return radius < other.radius;
+        if (height != other.height) return height < other.height;
+        if (sectors != other.sectors) return sectors < other.sectors;
+        if (stacks != other.stacks) return stacks < other.stacks;
+        return smooth < other.smooth;
+    }
+};
+
+// Handle returned by the registry; index into its mesh table
+typedef int MeshHandle;
+const MeshHandle INVALID_MESH = -1;
+
+// One primitive at several tessellations, finest first. sectors[] is kept
+// so the renderer can tell how coarse each level is around its silhouette.
+struct LodChain
+{
+    static const int MAX_LEVELS = 4;
+
+    MeshHandle levels[MAX_LEVELS];
+    int sectors[MAX_LEVELS];
+    int count;      // 0 = not a chain, draw the node's mesh as is
+};
+
+// Builds every unique procedural primitive once, uploads it to the GPU and
+// hands out a handle. The render loop only binds and draws. Every mesh,
+// procedural or hand-made, is indexed and cache-optimised before upload, and
+// all of them live in one geometry arena behind a single VAO.
+class MeshRegistry
+{
+public:
+    // Returns the mesh for key, generating and uploading it on first use
+    MeshHandle Acquire(const MeshKey& key)
+    {
+        std::map<MeshKey, MeshHandle>::const_iterator it = mLookup.find(key);
+        if (it != mLookup.end())
+            return it->second;
+
+        std::vector<GLfloat> vertices;
+        std::vector<GLuint> indices;
+        if (!Generate(key, vertices, indices))
+            return INVALID_MESH;
+
+        float generatedAcmr = mesh_optimizer::ComputeACMR(indices, vertices.size() / FLOATS_PER_VERTEX);
+        Optimize(vertices, indices);
+        Report(Describe(key), indices.size(), vertices.size() / FLOATS_PER_VERTEX, generatedAcmr,
+            mesh_optimizer::ComputeACMR(indices, vertices.size() / FLOATS_PER_VERTEX));
+
+        MeshHandle handle = Upload(vertices, indices);
+        if (handle != INVALID_MESH)
+            mLookup[key] = handle;
+        return handle;
+    }
+
+    // Acquires key and up to maxLevels - 1 coarser versions of it (each
+    // MeshKey::Coarser() than the last) as a LOD chain. Levels are shared
+    // with any other chain or Acquire() of the same key.
+    LodChain AcquireChain(const MeshKey& key, int maxLevels = LodChain::MAX_LEVELS)
+    {
+        LodChain chain;
+        chain.count = 0;
+        MeshKey level = key;
+        while (chain.count < std::min(maxLevels, (int)LodChain::MAX_LEVELS))
+        {
+            MeshHandle handle = Acquire(level);
+            if (handle == INVALID_MESH)
+                break;
+            chain.levels[chain.count] = handle;
+            chain.sectors[chain.count] = level.sectors;
+            ++chain.count;
+
+            MeshKey coarser = level.Coarser();
+            if (coarser.sectors == level.sectors && coarser.stacks == level.stacks)
+                break;
+            level = coarser;
+        }
+        return chain;
+    }
+
+    // Registers a hand-authored triangle soup (position / normal / uv per
+    // vertex, three vertices per triangle): welds identical vertices into an
+    // indexed mesh and optimises it before upload
+    MeshHandle AddStatic(const char* label, const GLfloat* soup, size_t nVertices)
+    {
+        std::vector<GLfloat> vertices;
+        std::vector<GLuint> indices;
+        mesh_optimizer::WeldVertices(soup, nVertices, FLOATS_PER_VERTEX, vertices, indices);
+
+        // as a soup every vertex is transformed once per triangle corner: ACMR 3
+        float weldedAcmr = mesh_optimizer::ComputeACMR(indices, vertices.size() / FLOATS_PER_VERTEX);
+        Optimize(vertices, indices);
+        std::cout << "INFO: Mesh '" << label << "' welded " << nVertices << " -> "
+            << vertices.size() / FLOATS_PER_VERTEX << " vertices" << std::endl;
+        Report(label, indices.size(), vertices.size() / FLOATS_PER_VERTEX, weldedAcmr,
+            mesh_optimizer::ComputeACMR(indices, vertices.size() / FLOATS_PER_VERTEX));
+
+        return Upload(vertices, indices);
+    }
+
+    const ArenaRange& Get(MeshHandle handle) const { return mMeshes[handle]; }
+
+    // Local-space box and sphere, computed from the vertices at upload
+    const MeshBounds& Bounds(MeshHandle handle) const { return mBounds[handle]; }
+
+    size_t Size() const { return mMeshes.size(); }
+
+    // The one VAO every mesh draws through
+    GLuint Vao() const { return mArena.Vao(); }
+
+    // Frees every GL object owned by the registry
+    void Release()
+    {
+        mCapture.Release();
+        mArena.Release();
+        mMeshes.clear();
+        mBounds.clear();
+        mLookup.clear();
+    }
+
+private:
+    static const int FLOATS_PER_VERTEX = GeometryArena::FLOATS_PER_VERTEX;
+
+    // false if the primitive could not be built
+    bool Generate(const MeshKey& key, std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+    {
+        switch (key.type)
+        {
+        case PrimitiveType::Sphere:
+            GenerateSphere(key, vertices, indices);
+            return true;
+        case PrimitiveType::Sphere2:
+            return GenerateCaptured(key, [&] { Sphere2 orb(key.radius, key.sectors, key.stacks); orb.Draw(); }, vertices, indices);
+        case PrimitiveType::Cylinder:
+            return GenerateCaptured(key, [&] { static_meshes_3D::Cylinder cylinder(key.radius, key.sectors, key.height, true, true, true); cylinder.render(); }, vertices, indices);
+        case PrimitiveType::Coaster:
+            return GenerateCaptured(key, [&] { static_meshes_3D::Coaster coaster(key.radius, key.sectors, key.height, true, true, true); coaster.render(); }, vertices, indices);
+        }
+        return false;
+    }
+
+    static std::string Describe(const MeshKey& key)
+    {
+        const char* names[] = { "sphere", "sphere2", "cylinder", "coaster" };
+        std::string label = names[(int)key.type];
+        label += " " + std::to_string(key.sectors);
+        if (key.type == PrimitiveType::Sphere || key.type == PrimitiveType::Sphere2)
+            label += "x" + std::to_string(key.stacks);
+        return label;
+    }
+
+    // Tipsify triangle order for the post-transform cache, then vertices
+    // renumbered in first-use order for fetch locality
+    static void Optimize(std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+    {
+        mesh_optimizer::OptimizeVertexCache(indices, vertices.size() / FLOATS_PER_VERTEX);
+        mesh_optimizer::OptimizeVertexFetch(vertices, indices, FLOATS_PER_VERTEX);
+    }
+
+    static void Report(const std::string& label, size_t nIndices, size_t nVertices, float acmrBefore, float acmrAfter)
+    {
+        char acmr[64];
+        snprintf(acmr, sizeof(acmr), "ACMR %.3f -> %.3f", acmrBefore, acmrAfter);
+        std::cout << "INFO: Mesh '" << label << "' " << nIndices / 3 << " triangles, "
+            << nVertices << " vertices, " << acmr << std::endl;
+    }
+
+    // Spheres come straight out of sphere.h, which already builds interleaved V/N/T data
+    static void GenerateSphere(const MeshKey& key, std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+    {
+        Sphere sphere(key.radius, key.sectors, key.stacks, key.smooth);
+
+        const GLfloat* v = sphere.getInterleavedVertices();
+        vertices.assign(v, v + sphere.getInterleavedVertexSize() / sizeof(GLfloat));
+
+        const unsigned int* i = sphere.getIndices();
+        indices.assign(i, i + sphere.getIndexCount());
+    }
+
+    // Sphere2, Cylinder and Coaster build their own buffers and only expose a
+    // draw call, so their vertex data is what one draw emits, welded back
+    // into an indexed mesh like the hand-made ones
+    bool GenerateCaptured(const MeshKey& key, const std::function<void()>& draw, std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+    {
+        if (!mCapture.Valid() && !mCapture.Init())
+            return false;
+        std::vector<GLfloat> soup;
+        if (!mCapture.Capture(Describe(key).c_str(), draw, soup))
+            return false;
+        mesh_optimizer::WeldVertices(soup.data(), soup.size() / FLOATS_PER_VERTEX, FLOATS_PER_VERTEX, vertices, indices);
+        return true;
+    }
+
+    MeshHandle Upload(const std::vector<GLfloat>& vertices, const std::vector<GLuint>& indices)
+    {
+        ArenaRange range;
+        if (!mArena.Allocate(vertices, indices, range))
+            return INVALID_MESH;
+
+        mMeshes.push_back(range);
+        mBounds.push_back(MeshBounds::FromVertices(vertices.data(), vertices.size() / FLOATS_PER_VERTEX, FLOATS_PER_VERTEX));
+        return (MeshHandle)(mMeshes.size() - 1);
+    }
+
+    std::map<MeshKey, MeshHandle> mLookup;
+    std::vector<ArenaRange> mMeshes;
+    std::vector<MeshBounds> mBounds;    // parallel to mMeshes
+    GeometryArena mArena;
+    MeshCapture mCapture;               // created on the first captured primitive
+};
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Nearest-rank percentile (0 < p <= 1) of a non-empty ascending list. The
+// profiler and the benchmark both report through this, so their p95 / p99
+// pick the same rank for the same sample count.
+inline float NearestRankPercentile(const std::vector<float>& sorted, double p)
+{
+    size_t rank = (size_t)std::ceil(p * sorted.size());
+    return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+// Named CPU + GPU timings for the stages of a frame. Scopes may nest.
+//
+// CPU time comes from steady_clock. GPU time comes from a pair of
+// GL_TIMESTAMP queries (glQueryCounter) per scope rather than
+// GL_TIME_ELAPSED, because only one TIME_ELAPSED query can be active at a
+// time and nested scopes would collide. Queries are read FRAMES_IN_FLIGHT
+// frames after they were issued and only when the result is already
+// available, so reading them never stalls the pipeline.
+//
+// Every scope keeps the last HISTORY samples; min / avg / p95 / p99 are
+// computed from those when reporting.
+class FrameProfiler
+{
+public:
+    static const int FRAMES_IN_FLIGHT = 3;
+    static const size_t HISTORY = 600;
+
+    struct Summary
+    {
+        float min, avg, p95, p99;
+        size_t samples;
+    };
+
+    FrameProfiler() : mFrame(0), mFramesProfiled(0), mGpuDropped(0) {}
+
+    // Collects the GPU results of the frame that used this slot last time,
+    // then hands the slot to the new frame
+    void BeginFrame()
+    {
+        FrameSlot& slot = mSlots[mFrame % FRAMES_IN_FLIGHT];
+
+        std::vector<double> gpuMs(mScopes.size(), 0.0);
+        std::vector<bool> gpuSeen(mScopes.size(), false);
+        for (size_t i = 0; i < slot.pending.size(); ++i)
+        {
+            const PendingQuery& pending = slot.pending[i];
+            GLuint available = 0;
+            glGetQueryObjectuiv(slot.queries[pending.endQuery], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+            {
+                ++mGpuDropped;
+                continue;
+            }
+
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(slot.queries[pending.beginQuery], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(slot.queries[pending.endQuery], GL_QUERY_RESULT, &end);
+            gpuMs[pending.scope] += (end - begin) / 1.0e6;
+            gpuSeen[pending.scope] = true;
+        }
+        for (size_t s = 0; s < gpuSeen.size(); ++s)
+        {
+            if (gpuSeen[s])
+                Push(mScopes[s].gpu, (float)gpuMs[s]);
+        }
+
+        slot.pending.clear();
+        slot.used = 0;
+        mCpuFrameMs.assign(mScopes.size(), 0.0);
+        mCpuFrameSeen.assign(mScopes.size(), false);
+    }
+
+    void EndFrame()
+    {
+        if (!mOpen.empty())
+            std::cout << "WARNING: Profiler scope '" << mScopes[mOpen.back().scope].name << "' still open at end of frame" << std::endl;
+        mOpen.clear();
+
+        for (size_t s = 0; s < mCpuFrameSeen.size(); ++s)
+        {
+            if (mCpuFrameSeen[s])
+                Push(mScopes[s].cpu, (float)mCpuFrameMs[s]);
+        }
+        ++mFrame;
+        ++mFramesProfiled;
+    }
+
+    void Begin(const char* name)
+    {
+        FrameSlot& slot = mSlots[mFrame % FRAMES_IN_FLIGHT];
+
+        OpenScope open;
+        open.scope = FindScope(name);
+        open.beginQuery = slot.Acquire();
+        open.start = std::chrono::steady_clock::now();
+        glQueryCounter(slot.queries[open.beginQuery], GL_TIMESTAMP);
+        mOpen.push_back(open);
+    }
+
+    void End()
+    {
+        if (mOpen.empty())
+        {
+            std::cout << "WARNING: Profiler End() without Begin()" << std::endl;
+            return;
+        }
+        OpenScope open = mOpen.back();
+        mOpen.pop_back();
+
+        FrameSlot& slot = mSlots[mFrame % FRAMES_IN_FLIGHT];
+        PendingQuery pending;
+        pending.scope = open.scope;
+        pending.beginQuery = open.beginQuery;
+        pending.endQuery = slot.Acquire();
+        glQueryCounter(slot.queries[pending.endQuery], GL_TIMESTAMP);
+        slot.pending.push_back(pending);
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - open.start;
+        mCpuFrameMs[open.scope] += elapsed.count();
+        mCpuFrameSeen[open.scope] = true;
+    }
+
+    // Latest rolling statistics, in milliseconds
+    Summary Cpu(const std::string& name) const { return Summarize(Lookup(name).cpu); }
+    Summary Gpu(const std::string& name) const { return Summarize(Lookup(name).gpu); }
+
+    bool WriteCsv(const std::string& path) const
+    {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file)
+        {
+            std::cout << "WARNING: Could not write profile to " << path << std::endl;
+            return false;
+        }
+        fprintf(file, "scope,cpu_min_ms,cpu_avg_ms,cpu_p95_ms,cpu_p99_ms,cpu_samples,gpu_min_ms,gpu_avg_ms,gpu_p95_ms,gpu_p99_ms,gpu_samples\n");
+        for (size_t s = 0; s < mScopes.size(); ++s)
+        {
+            Summary cpu = Summarize(mScopes[s].cpu);
+            Summary gpu = Summarize(mScopes[s].gpu);
+            fprintf(file, "%s,%.4f,%.4f,%.4f,%.4f,%zu,%.4f,%.4f,%.4f,%.4f,%zu\n", mScopes[s].name.c_str(),
+                cpu.min, cpu.avg, cpu.p95, cpu.p99, cpu.samples,
+                gpu.min, gpu.avg, gpu.p95, gpu.p99, gpu.samples);
+        }
+        fclose(file);
+        std::cout << "INFO: Profile written to " << path << std::endl;
+        return true;
+    }
+
+    bool WriteJson(const std::string& path) const
+    {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file)
+        {
+            std::cout << "WARNING: Could not write profile to " << path << std::endl;
+            return false;
+        }
+        fprintf(file, "{\n  \"frames\": %zu,\n  \"gpu_results_dropped\": %zu,\n  \"scopes\": [", mFramesProfiled, mGpuDropped);
+        for (size_t s = 0; s < mScopes.size(); ++s)
+        {
+            Summary cpu = Summarize(mScopes[s].cpu);
+            Summary gpu = Summarize(mScopes[s].gpu);
+            fprintf(file, "%s\n    { \"name\": \"%s\",\n", s ? "," : "", mScopes[s].name.c_str());
+            fprintf(file, "      \"cpu_ms\": { \"min\": %.4f, \"avg\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"samples\": %zu },\n",
+                cpu.min, cpu.avg, cpu.p95, cpu.p99, cpu.samples);
+            fprintf(file, "      \"gpu_ms\": { \"min\": %.4f, \"avg\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"samples\": %zu } }",
+                gpu.min, gpu.avg, gpu.p95, gpu.p99, gpu.samples);
+        }
+        fprintf(file, "\n  ]\n}\n");
+        fclose(file);
+        std::cout << "INFO: Profile written to " << path << std::endl;
+        return true;
+    }
+
+    // Waits for the GPU and collects every outstanding query, so the
+    // statistics include the last frames issued
+    void Flush()
+    {
+        glFinish();
+        for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
+        {
+            BeginFrame();
+            EndFrame();
+            --mFramesProfiled;
+        }
+    }
+
+    // Forgets all samples; scopes and query objects are kept
+    void Reset()
+    {
+        for (size_t s = 0; s < mScopes.size(); ++s)
+        {
+            mScopes[s].cpu.clear();
+            mScopes[s].gpu.clear();
+        }
+        mFramesProfiled = 0;
+        mGpuDropped = 0;
+    }
+
+    void Release()
+    {
+        for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
+        {
+            if (!mSlots[i].queries.empty())
+                glDeleteQueries((GLsizei)mSlots[i].queries.size(), mSlots[i].queries.data());
+            mSlots[i] = FrameSlot();
+        }
+    }
+
+private:
+    struct Scope
+    {
+        std::string name;
+        std::deque<float> cpu;  // ms per frame, newest last
+        std::deque<float> gpu;
+    };
+
+    struct OpenScope
+    {
+        size_t scope;
+        size_t beginQuery;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    struct PendingQuery
+    {
+        size_t scope;
+        size_t beginQuery;
+        size_t endQuery;
+    };
+
+    // Timestamp queries issued during one frame; reused FRAMES_IN_FLIGHT frames later
+    struct FrameSlot
+    {
+        FrameSlot() : used(0) {}
+
+        size_t Acquire()
+        {
+            if (used == queries.size())
+            {
+                GLuint query = 0;
+                glGenQueries(1, &query);
+                queries.push_back(query);
+            }
+            return used++;
+        }
+
+        std::vector<GLuint> queries;
+        std::vector<PendingQuery> pending;
+        size_t used;
+    };
+
+    size_t FindScope(const char* name)
+    {
+        std::map<std::string, size_t>::const_iterator it = mScopeIndex.find(name);
+        if (it != mScopeIndex.end())
+            return it->second;
+
+        size_t index = mScopes.size();
+        Scope scope;
+        scope.name = name;
+        mScopes.push_back(scope);
+        mScopeIndex[name] = index;
+        mCpuFrameMs.push_back(0.0);
+        mCpuFrameSeen.push_back(false);
+        return index;
+    }
+
+    const Scope& Lookup(const std::string& name) const
+    {
+        static const Scope empty;
+        std::map<std::string, size_t>::const_iterator it = mScopeIndex.find(name);
+        return it == mScopeIndex.end() ? empty : mScopes[it->second];
+    }
+
+    static void Push(std::deque<float>& history, float value)
+    {
+        history.push_back(value);
+        if (history.size() > HISTORY)
+            history.pop_front();
+    }
+
+    static Summary Summarize(const std::deque<float>& history)
+    {
+        Summary summary = { 0.0f, 0.0f, 0.0f, 0.0f, history.size() };
+        if (history.empty())
+            return summary;
+
+        std::vector<float> sorted(history.begin(), history.end());
+        std::sort(sorted.begin(), sorted.end());
+
+        double total = 0.0;
+        for (size_t i = 0; i < sorted.size(); ++i)
+            total += sorted[i];
+
+        summary.min = sorted.front();
+        summary.avg = (float)(total / sorted.size());
+        summary.p95 = NearestRankPercentile(sorted, 0.95);
+        summary.p99 = NearestRankPercentile(sorted, 0.99);
+        return summary;
+    }
+
+    std::vector<Scope> mScopes;
+    std::map<std::string, size_t> mScopeIndex;
+    std::vector<OpenScope> mOpen;
+    std::vector<double> mCpuFrameMs;     // this frame's total per scope
+    std::vector<bool> mCpuFrameSeen;
+    FrameSlot mSlots[FRAMES_IN_FLIGHT];
+    size_t mFrame;
+    size_t mFramesProfiled;
+    size_t mGpuDropped;
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Linked program binaries on disk, one file per program. A file is named
+// after the program and a hash of its shader sources plus the GL vendor,
+// renderer and version strings, so editing a shader or updating the driver
+// simply misses and writes a new file. A binary the driver refuses (it is
+// allowed to, e.g. after an update that kept the version string) is
+// deleted and counted as a miss; the caller compiles from source instead.
+class ProgramCache
+{
+public:
+    ProgramCache() : mEnabled(false), mHits(0), mMisses(0), mDriverHash(0) {}
+
+    // Needs a current context. Files go to PREFIX_label_hash.bin; an empty
+    // prefix, or a driver without binary formats, turns the cache off.
+    void Init(const std::string& prefix)
+    {
+        mPrefix = prefix;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        mEnabled = !prefix.empty() && formats > 0;
+        if (!prefix.empty() && formats == 0)
+            std::cout << "WARNING: Driver has no program binary formats, program cache disabled" << std::endl;
+
+        mDriverHash = FNV_OFFSET;
+        const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (int i = 0; i < 3; ++i)
+        {
+            const GLubyte* value = glGetString(strings[i]);
+            mDriverHash = Hash(value ? (const char*)value : "", mDriverHash);
+        }
+    }
+
+    bool Enabled() const { return mEnabled; }
+    int Hits() const { return mHits; }
+    int Misses() const { return mMisses; }
+
+    uint64_t Key(const char* vertexSource, const char* fragmentSource) const
+    {
+        return Hash(fragmentSource, Hash(vertexSource, mDriverHash));
+    }
+
+    // Fills program from the cached binary; false (and a miss) if there is
+    // none or the driver rejects it
+    bool Load(const std::string& label, uint64_t key, GLuint program)
+    {
+        if (!mEnabled)
+            return false;
+
+        const std::string path = Path(label, key);
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file)
+        {
+            ++mMisses;
+            return false;
+        }
+
+        Header header;
+        std::vector<char> binary;
+        bool valid = fread(&header, sizeof(header), 1, file) == 1
+            && memcmp(header.magic, MAGIC, sizeof(header.magic)) == 0
+            && header.version == VERSION && header.key == key && header.length > 0;
+        if (valid)
+        {
+            binary.resize(header.length);
+            valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+        }
+        fclose(file);
+
+        GLint linked = GL_FALSE;
+        if (valid)
+        {
+            glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        }
+        if (!linked)
+        {
+            std::cout << "WARNING: Program binary '" << path << "' rejected, recompiling" << std::endl;
+            remove(path.c_str());
+            ++mMisses;
+            return false;
+        }
+
+        ++mHits;
+        return true;
+    }
+
+    // Call before glLinkProgram so the driver keeps a binary it can return
+    void PrepareForSave(GLuint program) const
+    {
+        if (mEnabled)
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // Writes a successfully linked program's binary
+    void Save(const std::string& label, uint64_t key, GLuint program) const
+    {
+        if (!mEnabled)
+            return;
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        Header header;
+        memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.key = key;
+        GLsizei written = 0;
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &written, &format, binary.data());
+        header.format = format;
+        header.length = (uint32_t)written;
+
+        const std::string path = Path(label, key);
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "WARNING: Could not write program binary '" << path << "'" << std::endl;
+            return;
+        }
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(binary.data(), 1, header.length, file);
+        fclose(file);
+    }
+
+private:
+    static const uint64_t FNV_OFFSET = 14695981039346656037ull;
+    static const uint64_t FNV_PRIME = 1099511628211ull;
+    static const uint32_t VERSION = 1;
+    static constexpr const char* MAGIC = "PBIN";
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    // FNV-1a over the string and its terminator, so "ab" + "c" != "a" + "bc"
+    static uint64_t Hash(const char* text, uint64_t hash)
+    {
+        const char* c = text;
+        do
+        {
+            hash ^= (unsigned char)*c;
+            hash *= FNV_PRIME;
+        } while (*c++);
+        return hash;
+    }
+
+    std::string Path(const std::string& label, uint64_t key) const
+    {
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)key);
+        return mPrefix + "_" + label + "_" + hex + ".bin";
+    }
+
+    std::string mPrefix;
+    bool mEnabled;
+    int mHits;
+    int mMisses;
+    uint64_t mDriverHash;
+};
@@ -0,0 +1,445 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "gpu_resources.h"
+#include "material_textures.h"
+#include "mesh_registry.h"
+#include "shader.h"
+
+// One object waiting to be drawn this frame
+struct DrawItem
+{
+    uint64_t key;                   // program | mesh | depth indices, sorted ascending
+    const ShaderProgram* program;
+    const MaterialSlot* material;   // nullptr = no texture needed
+    MeshHandle mesh;
+    const glm::mat4* model;         // owned by the scene graph, valid for the frame
+    const glm::mat3* normalMatrix;  // likewise
+};
+
+// What the vertex shaders read per instance: the model matrix at locations
+// 3-6, the normal matrix (inverse transpose of the model's 3x3) at 7-9 and
+// where the material sits in the texture array at 10-11
+struct InstanceData
+{
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+    glm::vec4 uvRect;
+    glm::vec2 layerLod;     // layer, max lod
+};
+
+// Layout glMultiDrawElementsIndirect reads from the indirect buffer
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// State changes the queue issued versus the ones it skipped because the
+// previous draw already had the same state bound. Binds are counted per
+// object, so everything after the first object of a multi-draw is elided,
+// and the material array is bound once for every textured object. A frame
+// drawn in several passes adds up what each pass issued and skipped, so
+// every object drawn counts once per pass it appears in.
+struct RenderStats
+{
+    int instances;      // objects submitted
+    int passes;         // Draw() calls that drew something
+    int draws;          // indirect draw commands (one per mesh per state run)
+    int multiDraws;     // glMultiDrawElementsIndirect calls
+    int programBinds, programBindsElided;
+    int textureBinds, textureBindsElided;
+    int vaoBinds, vaoBindsElided;
+};
+
+// Collects the frame's draws, sorts them by state and submits them with only
+// the binds that actually change something. Runs of items sharing program
+// and mesh become one indirect draw command; consecutive commands sharing a
+// program go out in one glMultiDrawElementsIndirect. Model and normal
+// matrices and material slots are streamed into a per-instance buffer and
+// the commands into an indirect buffer once per frame. All meshes share the
+// registry's arena VAO and all materials the one texture array, so each is
+// bound once. A frame split over several passes (the deferred path) calls
+// Prepare() once and Draw() per pass with the programs that pass wants.
+class RenderQueue
+{
+public:
+    RenderQueue()
+        : mMaxDepth(100.0f), mFrontToBack(false), mInstanceCapacity(0), mIndirectCapacity(0)
+    {
+        mStats = RenderStats();
+    }
+
+    static const GLuint INSTANCE_MODEL_LOCATION = 3;
+    static const GLuint INSTANCE_NORMAL_LOCATION = 7;
+    static const GLuint INSTANCE_UV_RECT_LOCATION = 10;
+    static const GLuint INSTANCE_LAYER_LOCATION = 11;
+
+    // Creates the per-instance and indirect buffers and wires the instance
+    // attributes into the arena VAO. Call after the first mesh is registered.
+    void Init(const MeshRegistry& meshes)
+    {
+        mInstanceBuffer.Create("render queue instances");
+        Reserve(256);
+        mIndirectBuffer.Create("render queue commands");
+        ReserveCommands(64);
+
+        const GLsizei stride = sizeof(InstanceData);
+        glBindBuffer(GL_ARRAY_BUFFER, mInstanceBuffer.Id());
+        glBindVertexArray(meshes.Vao());
+        for (GLuint column = 0; column < 4; ++column)
+        {
+            GLuint location = INSTANCE_MODEL_LOCATION + column;
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec4) * column));
+            glVertexAttribDivisor(location, 1);
+            glEnableVertexAttribArray(location);
+        }
+        for (GLuint column = 0; column < 3; ++column)
+        {
+            GLuint location = INSTANCE_NORMAL_LOCATION + column;
+            glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::mat4) + sizeof(glm::vec3) * column));
+            glVertexAttribDivisor(location, 1);
+            glEnableVertexAttribArray(location);
+        }
+        glVertexAttribPointer(INSTANCE_UV_RECT_LOCATION, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(InstanceData, uvRect));
+        glVertexAttribDivisor(INSTANCE_UV_RECT_LOCATION, 1);
+        glEnableVertexAttribArray(INSTANCE_UV_RECT_LOCATION);
+        glVertexAttribPointer(INSTANCE_LAYER_LOCATION, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(InstanceData, layerLod));
+        glVertexAttribDivisor(INSTANCE_LAYER_LOCATION, 1);
+        glEnableVertexAttribArray(INSTANCE_LAYER_LOCATION);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void Release()
+    {
+        mInstanceBuffer.Reset();
+        mIndirectBuffer.Reset();
+        mInstanceCapacity = mIndirectCapacity = 0;
+    }
+
+    // Depth values at or beyond this land in the last depth bucket
+    void SetMaxDepth(float maxDepth) { mMaxDepth = maxDepth; }
+
+    // On = sort nearest first across programs and meshes, so early depth
+    // testing rejects as much as it can, at the cost of program binds
+    // (runs only merge when neighbours happen to share state). Applies to
+    // items submitted after the call.
+    void SetFrontToBack(bool frontToBack) { mFrontToBack = frontToBack; }
+
+    void Clear()
+    {
+        mItems.clear();
+        mFramePrograms.clear();
+        for (size_t i = 0; i < mFrameMeshes.size(); ++i)
+            mMeshIndex[mFrameMeshes[i]] = -1;
+        mFrameMeshes.clear();
+    }
+
+    void Submit(const ShaderProgram* program, const MaterialSlot* material, MeshHandle mesh,
+        const glm::mat4& model, const glm::mat3& normalMatrix, float depth)
+    {
+        DrawItem item;
+        item.key = MakeKey(ProgramIndex(program), MeshIndex(mesh), depth);
+        item.program = program;
+        item.material = material;
+        item.mesh = mesh;
+        item.model = &model;
+        item.normalMatrix = &normalMatrix;
+        mItems.push_back(item);
+    }
+
+    void Sort()
+    {
+        std::sort(mItems.begin(), mItems.end(), [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+    }
+
+    void Flush(const MeshRegistry& meshes, const MaterialTextures& materials)
+    {
+        Prepare(meshes);
+        Draw(meshes, materials);
+    }
+
+    // Streams the sorted items' instance data and indirect commands to the
+    // GPU. Nothing is drawn until Draw().
+    void Prepare(const MeshRegistry& meshes)
+    {
+        mStats = RenderStats();
+        mStats.instances = (int)mItems.size();
+        mRuns.clear();
+        if (mItems.empty())
+            return;
+
+        // sorted order is instance order, so every batch is a contiguous range
+        mInstanceData.resize(mItems.size());
+        for (size_t i = 0; i < mItems.size(); ++i)
+        {
+            const DrawItem& item = mItems[i];
+            InstanceData& instance = mInstanceData[i];
+            instance.model = *item.model;
+            instance.normalMatrix = *item.normalMatrix;
+            if (item.material)
+            {
+                instance.uvRect = item.material->uvRect;
+                instance.layerLod = glm::vec2(item.material->layer, item.material->maxLod);
+            }
+            else
+            {
+                instance.uvRect = glm::vec4(0.0f);
+                instance.layerLod = glm::vec2(0.0f);
+            }
+        }
+        UploadInstances();
+
+        // one command per program / mesh batch, grouped into runs that only
+        // differ by mesh
+        mCommands.clear();
+        mRuns.clear();
+        size_t first = 0;
+        while (first < mItems.size())
+        {
+            const DrawItem& item = mItems[first];
+            size_t last = first + 1;
+            while (last < mItems.size() && SameBatch(item, mItems[last]))
+                ++last;
+
+            const ArenaRange& range = meshes.Get(item.mesh);
+            DrawElementsIndirectCommand command;
+            command.count = (GLuint)range.nIndices;
+            command.instanceCount = (GLuint)(last - first);
+            command.firstIndex = range.firstIndex;
+            command.baseVertex = range.baseVertex;
+            command.baseInstance = (GLuint)first;
+
+            if (mRuns.empty() || !SameState(mItems[mRuns.back().firstItem], item))
+            {
+                Run run = { first, mCommands.size(), 0, 0 };
+                mRuns.push_back(run);
+            }
+            ++mRuns.back().commandCount;
+            if (item.material)
+                mRuns.back().texturedItems += (int)(last - first);
+            mCommands.push_back(command);
+
+            first = last;
+        }
+        UploadCommands();
+    }
+
+    // Draws the prepared runs drawn with only (every program when null),
+    // skipping the ones drawn with except
+    void Draw(const MeshRegistry& meshes, const MaterialTextures& materials,
+        const ShaderProgram* only = nullptr, const ShaderProgram* except = nullptr)
+    {
+        // what this pass draws, so its binds are counted against its own objects
+        int drawn = 0, textured = 0;
+        for (size_t r = 0; r < mRuns.size(); ++r)
+        {
+            if (!InPass(mRuns[r], only, except))
+                continue;
+            drawn += (int)(RunEnd(r) - mRuns[r].firstItem);
+            textured += mRuns[r].texturedItems;
+        }
+        if (drawn == 0)
+            return;
+        ++mStats.passes;
+
+        // everything samples the material array on unit 0 and draws from the arena
+        glActiveTexture(GL_TEXTURE0);
+        if (textured > 0)
+        {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, materials.Texture());
+            ++mStats.textureBinds;
+            mStats.textureBindsElided += textured - 1;
+        }
+        glBindVertexArray(meshes.Vao());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mIndirectBuffer.Id());
+        ++mStats.vaoBinds;
+        mStats.vaoBindsElided += drawn - 1;
+
+        const ShaderProgram* currentProgram = nullptr;
+
+        for (size_t r = 0; r < mRuns.size(); ++r)
+        {
+            const Run& run = mRuns[r];
+            const DrawItem& item = mItems[run.firstItem];
+            const size_t nextItem = RunEnd(r);
+            if (!InPass(run, only, except))
+                continue;
+
+            if (item.program != currentProgram)
+            {
+                currentProgram = item.program;
+                glUseProgram(currentProgram->Id());
+                ++mStats.programBinds;
+            }
+            else
+                ++mStats.programBindsElided;
+
+            // the rest of the run rides along without any binds at all
+            mStats.programBindsElided += (int)(nextItem - run.firstItem - 1);
+
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GeometryArena::INDEX_TYPE,
+                (void*)(run.firstCommand * sizeof(DrawElementsIndirectCommand)), (GLsizei)run.commandCount, 0);
+            mStats.draws += (int)run.commandCount;
+            ++mStats.multiDraws;
+        }
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    // Every prepared command in one multi-draw with the program the caller
+    // bound, for passes such as the depth pre-pass that need no per-run
+    // state. Not counted in Stats().
+    void DrawAll(const MeshRegistry& meshes) const
+    {
+        if (mCommands.empty())
+            return;
+        glBindVertexArray(meshes.Vao());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mIndirectBuffer.Id());
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GeometryArena::INDEX_TYPE, (void*)0, (GLsizei)mCommands.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    const RenderStats& Stats() const { return mStats; }
+
+private:
+    // Consecutive commands sharing these go out in one multi-draw
+    struct Run
+    {
+        size_t firstItem;
+        size_t firstCommand;
+        size_t commandCount;
+        int texturedItems;
+    };
+
+    bool InPass(const Run& run, const ShaderProgram* only, const ShaderProgram* except) const
+    {
+        const ShaderProgram* program = mItems[run.firstItem].program;
+        return (!only || program == only) && program != except;
+    }
+
+    // One past the run's last item
+    size_t RunEnd(size_t r) const
+    {
+        return r + 1 < mRuns.size() ? mRuns[r + 1].firstItem : mItems.size();
+    }
+
+    static bool SameState(const DrawItem& a, const DrawItem& b)
+    {
+        return a.program == b.program;
+    }
+
+    static bool SameBatch(const DrawItem& a, const DrawItem& b)
+    {
+        return SameState(a, b) && a.mesh == b.mesh;
+    }
+
+    void Reserve(size_t instances)
+    {
+        mInstanceCapacity = instances;
+        glBindBuffer(GL_ARRAY_BUFFER, mInstanceBuffer.Id());
+        glBufferData(GL_ARRAY_BUFFER, mInstanceCapacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        mInstanceBuffer.SetSize(mInstanceCapacity * sizeof(InstanceData));
+    }
+
+    void UploadInstances()
+    {
+        if (mInstanceData.size() > mInstanceCapacity)
+            Reserve(mInstanceData.size() * 2);
+
+        // orphan last frame's storage so the driver never waits on it
+        glBindBuffer(GL_ARRAY_BUFFER, mInstanceBuffer.Id());
+        glBufferData(GL_ARRAY_BUFFER, mInstanceCapacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, mInstanceData.size() * sizeof(InstanceData), mInstanceData.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void ReserveCommands(size_t commands)
+    {
+        mIndirectCapacity = commands;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mIndirectBuffer.Id());
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, mIndirectCapacity * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        mIndirectBuffer.SetSize(mIndirectCapacity * sizeof(DrawElementsIndirectCommand));
+    }
+
+    void UploadCommands()
+    {
+        if (mCommands.size() > mIndirectCapacity)
+            ReserveCommands(mCommands.size() * 2);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mIndirectBuffer.Id());
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, mIndirectCapacity * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, mCommands.size() * sizeof(DrawElementsIndirectCommand), mCommands.data());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    // Programs and meshes are numbered in the order this frame first submits
+    // them, so the key fields hold small indices rather than GL names or
+    // registry handles that could outgrow them. Past the field widths the
+    // indices saturate; that only costs batching, runs still compare the
+    // real program and mesh.
+    uint32_t ProgramIndex(const ShaderProgram* program)
+    {
+        for (size_t i = 0; i < mFramePrograms.size(); ++i)
+            if (mFramePrograms[i] == program)
+                return (uint32_t)i;
+        mFramePrograms.push_back(program);
+        return (uint32_t)(mFramePrograms.size() - 1);
+    }
+
+    uint32_t MeshIndex(MeshHandle mesh)
+    {
+        if ((size_t)mesh >= mMeshIndex.size())
+            mMeshIndex.resize((size_t)mesh + 1, -1);
+        if (mMeshIndex[mesh] < 0)
+        {
+            mMeshIndex[mesh] = (int)mFrameMeshes.size();
+            mFrameMeshes.push_back(mesh);
+        }
+        return (uint32_t)mMeshIndex[mesh];
+    }
+
+    // 12 bits program index, 16 bits mesh index, 36 bits depth (near
+    // first), or depth first when sorting front to back. Materials are per
+    // instance, so they no longer take part.
+    uint64_t MakeKey(uint32_t programIndex, uint32_t meshIndex, float depth) const
+    {
+        const uint64_t depthMax = (1ull << 36) - 1;
+        float normalised = std::min(std::max(depth / mMaxDepth, 0.0f), 1.0f);
+        uint64_t depthBits = (uint64_t)((double)normalised * depthMax);
+        const uint64_t program = std::min(programIndex, 0xFFFu);
+        const uint64_t mesh = std::min(meshIndex, 0xFFFFu);
+
+        if (mFrontToBack)
+            return (depthBits << 28) | (program << 16) | mesh;
+        return (program << 52) | (mesh << 36) | depthBits;
+    }
+
+    std::vector<DrawItem> mItems;
+    std::vector<InstanceData> mInstanceData;
+    std::vector<DrawElementsIndirectCommand> mCommands;
+    std::vector<Run> mRuns;
+    std::vector<const ShaderProgram*> mFramePrograms;  // key index -> program, this frame
+    std::vector<MeshHandle> mFrameMeshes;               // key index -> mesh, this frame
+    std::vector<int> mMeshIndex;                        // mesh handle -> key index, -1 = not yet
+    RenderStats mStats;
+    float mMaxDepth;
+    bool mFrontToBack;
+    GpuBuffer mInstanceBuffer;
+    size_t mInstanceCapacity;   // in instances
+    GpuBuffer mIndirectBuffer;
+    size_t mIndirectCapacity;   // in commands
+};
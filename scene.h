@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include "material_textures.h"
+#include "mesh_registry.h"
+#include "shader.h"
+
+typedef int NodeId;
+const NodeId NO_PARENT = -1;
+
+// One object in the scene: local translate / rotate / scale, a parent link,
+// what to draw it with, and its world matrix cached from the last update
+struct SceneNode
+{
+    glm::vec3 position;
+    float rotationAngle;        // passed straight to glm::rotate, like the old hand-written blocks
+    glm::vec3 rotationAxis;
+    glm::vec3 scale;
+
+    NodeId parent;
+    std::vector<NodeId> children;
+
+    MeshHandle mesh;            // the finest level when the node has a LOD chain
+    LodChain lod;               // count 0 = always draw mesh
+    MaterialId material;        // NO_MATERIAL = untextured
+    const ShaderProgram* program;
+    bool castsShadow;           // drawn into the key light's shadow map
+
+    glm::mat4 world;            // parent world * translation * rotation * scale
+    glm::mat3 normalMatrix;     // inverse transpose of world's 3x3, rebuilt with world
+    bool uniformScale;          // this node and all its ancestors scale evenly on x, y, z
+    bool dirty;
+};
+
+// Flat list of scene nodes. Parents are always added before their children,
+// so a node's index is larger than its parent's. Setters mark a node dirty and
+// Update() recomputes only the dirty nodes and their descendants.
+// CasterVersion() changes whenever a shadow caster's world matrix is rebuilt
+// or a node starts / stops casting, so cached shadow maps know when to redraw.
+class SceneGraph
+{
+public:
+    SceneGraph() : mCasterVersion(0) {}
+
+    NodeId AddNode(MeshHandle mesh, MaterialId material, const ShaderProgram* program, NodeId parent = NO_PARENT)
+    {
+        SceneNode node;
+        node.position = glm::vec3(0.0f);
+        node.rotationAngle = 0.0f;
+        node.rotationAxis = glm::vec3(0.0f, 1.0f, 0.0f);
+        node.scale = glm::vec3(1.0f);
+        node.parent = parent;
+        node.mesh = mesh;
+        node.lod.count = 0;
+        node.material = material;
+        node.program = program;
+        node.castsShadow = true;
+        node.world = glm::mat4(1.0f);
+        node.normalMatrix = glm::mat3(1.0f);
+        node.uniformScale = true;
+        node.dirty = false;
+
+        NodeId id = (NodeId)mNodes.size();
+        mNodes.push_back(node);
+        if (parent != NO_PARENT)
+            mNodes[parent].children.push_back(id);
+        MarkDirty(id);
+        return id;
+    }
+
+    // Node drawn at whichever level of lod the renderer picks; its bounds
+    // come from the finest level, which encloses the coarser ones
+    NodeId AddNode(const LodChain& lod, MaterialId material, const ShaderProgram* program, NodeId parent = NO_PARENT)
+    {
+        NodeId id = AddNode(lod.count > 0 ? lod.levels[0] : INVALID_MESH, material, program, parent);
+        mNodes[id].lod = lod;
+        return id;
+    }
+
+    void SetPosition(NodeId id, const glm::vec3& position)
+    {
+        mNodes[id].position = position;
+        MarkDirty(id);
+    }
+
+    void SetRotation(NodeId id, float angle, const glm::vec3& axis)
+    {
+        mNodes[id].rotationAngle = angle;
+        mNodes[id].rotationAxis = axis;
+        MarkDirty(id);
+    }
+
+    void SetScale(NodeId id, const glm::vec3& scale)
+    {
+        mNodes[id].scale = scale;
+        MarkDirty(id);
+    }
+
+    void SetCastsShadow(NodeId id, bool castsShadow)
+    {
+        if (mNodes[id].castsShadow != castsShadow)
+            ++mCasterVersion;
+        mNodes[id].castsShadow = castsShadow;
+    }
+
+    // Recomputes world matrices for dirty nodes and their subtrees.
+    // Returns how many matrices were rebuilt.
+    int Update()
+    {
+        int rebuilt = 0;
+
+        // parents have lower ids, so sorting means a parent rebuilds its subtree
+        // before any dirty descendant is visited (which is then already clean)
+        std::sort(mDirtyList.begin(), mDirtyList.end());
+        for (size_t i = 0; i < mDirtyList.size(); ++i)
+        {
+            if (mNodes[mDirtyList[i]].dirty)
+                rebuilt += Rebuild(mDirtyList[i]);
+        }
+        mDirtyList.clear();
+        return rebuilt;
+    }
+
+    const SceneNode& Node(NodeId id) const { return mNodes[id]; }
+    const std::vector<SceneNode>& Nodes() const { return mNodes; }
+    unsigned int CasterVersion() const { return mCasterVersion; }
+
+private:
+    void MarkDirty(NodeId id)
+    {
+        if (!mNodes[id].dirty)
+        {
+            mNodes[id].dirty = true;
+            mDirtyList.push_back(id);
+        }
+    }
+
+    int Rebuild(NodeId id)
+    {
+        SceneNode& node = mNodes[id];
+
+        glm::mat4 local = glm::translate(node.position)
+            * glm::rotate(node.rotationAngle, node.rotationAxis)
+            * glm::scale(node.scale);
+        node.world = node.parent == NO_PARENT ? local : mNodes[node.parent].world * local;
+
+        // with only rotation and even scaling the 3x3 is already a valid normal
+        // matrix (the shaders normalise), so the inverse is only paid for
+        // objects that are squashed or stretched
+        node.uniformScale = node.scale.x == node.scale.y && node.scale.y == node.scale.z
+            && (node.parent == NO_PARENT || mNodes[node.parent].uniformScale);
+        glm::mat3 upper(node.world);
+        node.normalMatrix = node.uniformScale ? upper : glm::transpose(glm::inverse(upper));
+        node.dirty = false;
+        if (node.castsShadow)
+            ++mCasterVersion;
+
+        int rebuilt = 1;
+        for (size_t i = 0; i < node.children.size(); ++i)
+            rebuilt += Rebuild(node.children[i]);
+        return rebuilt;
+    }
+
+    std::vector<SceneNode> mNodes;
+    std::vector<NodeId> mDirtyList;
+    unsigned int mCasterVersion;
+};
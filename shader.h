@@ -0,0 +1,150 @@
+#pragma once
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "gpu_resources.h"
+
+// A linked GL program plus everything learned about it right after linking:
+// the active uniforms and attributes, their locations and types. Locations
+// are looked up by name only while loading; the frame loop uses the cached
+// GLint values with the typed setters. Owns the program object.
+class ShaderProgram
+{
+public:
+    struct Variable
+    {
+        GLint location;
+        GLenum type;
+        GLint size;
+        bool used;      // requested by the engine at least once
+    };
+
+    explicit ShaderProgram(const char* label = "program")
+        : mLabel(label)
+    {
+    }
+
+    GLuint Id() const { return mProgram.Id(); }
+    const std::string& Label() const { return mLabel; }
+
+    // Takes over a freshly linked program and enumerates its active
+    // uniforms and attributes
+    void Reflect(GpuProgram&& program)
+    {
+        mProgram = std::move(program);
+        const GLuint id = mProgram.Id();
+        mUniforms.clear();
+        mAttributes.clear();
+
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            Variable var = { -1, 0, 0, false };
+            glGetActiveUniform(id, (GLuint)i, maxLength, &length, &var.size, &var.type, &name[0]);
+            std::string uniformName = StripArraySuffix(name.substr(0, length));
+            var.location = glGetUniformLocation(id, uniformName.c_str());
+            // members of uniform blocks have no location and are not set through here
+            if (var.location >= 0)
+                mUniforms[uniformName] = var;
+        }
+
+        glGetProgramiv(id, GL_ACTIVE_ATTRIBUTES, &count);
+        glGetProgramiv(id, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+        name.assign(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            Variable var = { -1, 0, 0, false };
+            glGetActiveAttrib(id, (GLuint)i, maxLength, &length, &var.size, &var.type, &name[0]);
+            std::string attribName = name.substr(0, length);
+            var.location = glGetAttribLocation(id, attribName.c_str());
+            mAttributes[attribName] = var;
+        }
+
+        std::cout << "INFO: Program '" << mLabel << "': " << mUniforms.size() << " active uniforms, "
+            << mAttributes.size() << " active attributes" << std::endl;
+    }
+
+    // Load-time lookup. Reports names that are not active in the program
+    // (misspelled, or optimised out because the shader never reads them).
+    GLint Uniform(const char* name)
+    {
+        GLint location = Find(mUniforms, name);
+        if (location < 0)
+            std::cout << "WARNING: Program '" << mLabel << "' has no active uniform '" << name << "'" << std::endl;
+        return location;
+    }
+
+    GLint Attribute(const char* name)
+    {
+        GLint location = Find(mAttributes, name);
+        if (location < 0)
+            std::cout << "WARNING: Program '" << mLabel << "' has no active attribute '" << name << "'" << std::endl;
+        return location;
+    }
+
+    // Points a named uniform block at a buffer binding point. The shaders
+    // already declare the binding; this also reports blocks that are missing.
+    bool BindUniformBlock(const char* name, GLuint binding) const
+    {
+        GLuint index = glGetUniformBlockIndex(Id(), name);
+        if (index == GL_INVALID_INDEX)
+        {
+            std::cout << "WARNING: Program '" << mLabel << "' has no active uniform block '" << name << "'" << std::endl;
+            return false;
+        }
+        glUniformBlockBinding(Id(), index, binding);
+        return true;
+    }
+
+    // Reports active uniforms the engine never asked for, i.e. never sets
+    void ReportUnused() const
+    {
+        for (std::map<std::string, Variable>::const_iterator it = mUniforms.begin(); it != mUniforms.end(); ++it)
+        {
+            if (!it->second.used)
+                std::cout << "WARNING: Program '" << mLabel << "' uniform '" << it->first << "' is never set" << std::endl;
+        }
+    }
+
+    // Typed setters on cached locations; no program needs to be bound
+    void Set(GLint location, int value) const { glProgramUniform1i(Id(), location, value); }
+    void Set(GLint location, float value) const { glProgramUniform1f(Id(), location, value); }
+    void Set(GLint location, const glm::vec2& value) const { glProgramUniform2fv(Id(), location, 1, glm::value_ptr(value)); }
+    void Set(GLint location, const glm::vec3& value) const { glProgramUniform3fv(Id(), location, 1, glm::value_ptr(value)); }
+    void Set(GLint location, const glm::mat4& value) const { glProgramUniformMatrix4fv(Id(), location, 1, GL_FALSE, glm::value_ptr(value)); }
+
+    void Destroy() { mProgram.Reset(); }
+
+private:
+    static std::string StripArraySuffix(const std::string& name)
+    {
+        size_t bracket = name.find('[');
+        return bracket == std::string::npos ? name : name.substr(0, bracket);
+    }
+
+    static GLint Find(std::map<std::string, Variable>& table, const char* name)
+    {
+        std::map<std::string, Variable>::iterator it = table.find(name);
+        if (it == table.end())
+            return -1;
+        it->second.used = true;
+        return it->second.location;
+    }
+
+    GpuProgram mProgram;
+    std::string mLabel;
+    std::map<std::string, Variable> mUniforms;
+    std::map<std::string, Variable> mAttributes;
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include "gpu_resources.h"
+
+// Depth map of the key light, sampled with hardware comparison (2x2 PCF per
+// tap) by the lit shaders. A point light has no single direction, so the map
+// is a perspective view from the light aimed at the sphere holding every
+// shadow caster and just wide enough to contain it.
+//
+// Drawing the map is a pass over the whole scene, so it is cached: Stale()
+// is only true when the light moved or the scene's caster version changed
+// since the last render. Aim() then Begin() / End() around the casters'
+// draws rebuild it; everything else only samples it.
+class ShadowMap
+{
+public:
+    static const GLuint UNIT = 4;       // after the G-buffer's units
+    static const int SIZE = 2048;
+
+    ShadowMap() : mVersion(0), mRebuilds(0), mValid(false)
+    {
+        mLight = glm::vec3(0.0f);
+        mMatrix = glm::mat4(1.0f);
+    }
+
+    // Needs a current context; false if the FBO is incomplete
+    bool Create()
+    {
+        mDepth.Create("shadow map");
+        glBindTexture(GL_TEXTURE_2D, mDepth.Id());
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, SIZE, SIZE);
+        // linear + compare = each lookup averages a 2x2 block of depth tests
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        // outside the map counts as lit
+        const GLfloat border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        mDepth.SetSize((size_t)SIZE * SIZE * 4);
+
+        GLint previous = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+        mFbo.Create("shadow map");
+        glBindFramebuffer(GL_FRAMEBUFFER, mFbo.Id());
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mDepth.Id(), 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previous);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "WARNING: Shadow map incomplete: 0x" << std::hex << status << std::dec << std::endl;
+            Release();
+            return false;
+        }
+        return true;
+    }
+
+    bool Valid() const { return (bool)mFbo; }
+
+    // True when the map no longer matches the light or the casters
+    bool Stale(const glm::vec3& light, unsigned int casterVersion) const
+    {
+        return !mValid || light != mLight || casterVersion != mVersion;
+    }
+
+    // Points the light's view at the sphere (center, radius) around every
+    // caster and remembers what the map is about to be drawn for
+    void Aim(const glm::vec3& light, unsigned int casterVersion, const glm::vec3& center, float radius)
+    {
+        mLight = light;
+        mVersion = casterVersion;
+
+        glm::vec3 toCenter = center - light;
+        float distance = glm::length(toCenter);
+        if (distance < 1e-4f)
+        {
+            toCenter = glm::vec3(0.0f, -1.0f, 0.0f);
+            distance = 0.0f;
+        }
+        const glm::vec3 up = std::fabs(toCenter.y) > 0.99f * glm::length(toCenter) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        const glm::mat4 view = glm::lookAt(light, light + toCenter, up);
+
+        // outside the sphere: the cone that just touches it. Inside: as wide
+        // as one map usefully goes, casters behind the light get no shadow
+        float fov, zNear;
+        if (distance > radius * 1.01f)
+        {
+            fov = 2.0f * asinf(radius / distance);
+            zNear = distance - radius;
+        }
+        else
+        {
+            fov = glm::radians(150.0f);
+            zNear = radius * 0.01f;
+        }
+        const float zFar = distance + radius;
+        mMatrix = glm::perspective(fov, 1.0f, std::max(zNear, 0.01f), zFar) * view;
+    }
+
+    // World to the map's clip space, for the shadow pass and the lookups
+    const glm::mat4& Matrix() const { return mMatrix; }
+
+    // Binds the map as the target and clears it. The slope scaled offset
+    // keeps surfaces from shadowing themselves (acne).
+    void Begin() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, mFbo.Id());
+        glViewport(0, 0, SIZE, SIZE);
+        const GLfloat one = 1.0f;
+        glClearBufferfv(GL_DEPTH, 0, &one);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+    }
+
+    // The caller restores its framebuffer and viewport
+    void End()
+    {
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        mValid = true;
+        ++mRebuilds;
+    }
+
+    void Bind() const
+    {
+        glActiveTexture(GL_TEXTURE0 + UNIT);
+        glBindTexture(GL_TEXTURE_2D, mDepth.Id());
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Times the map was drawn since Create()
+    int Rebuilds() const { return mRebuilds; }
+
+    void Release()
+    {
+        mFbo.Reset();
+        mDepth.Reset();
+        mValid = false;
+    }
+
+private:
+    GpuFramebuffer mFbo;
+    GpuTexture mDepth;
+    glm::vec3 mLight;
+    unsigned int mVersion;
+    glm::mat4 mMatrix;
+    int mRebuilds;
+    bool mValid;
+};
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <GL/glew.h>
+
+// Cooked texture container (.tex), written by texture_cook and read here.
+// Rows are already flipped for GL (bottom row first) and every mip level is
+// stored, so loading is a straight copy of each level into the texture.
+//
+//   CookedHeader               24 bytes, little endian
+//   CookedLevel[levels]        24 bytes each, level 0 (largest) first
+//   level payloads             each starts on a 16 byte boundary
+namespace cooked
+{
+    const char MAGIC[4] = { 'T', 'X', 'C', '1' };
+    const uint32_t VERSION = 1;
+
+    enum Format : uint32_t
+    {
+        FORMAT_RGB8 = 1,
+        FORMAT_RGBA8 = 2,
+        FORMAT_BC1 = 3,     // DXT1, 4 bpp, opaque
+        FORMAT_BC3 = 4,     // DXT5, 8 bpp, with alpha
+        FORMAT_BC7 = 5      // BPTC, 8 bpp (loader only; produced by external encoders)
+    };
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levels;
+    };
+
+    struct Level
+    {
+        uint32_t width;
+        uint32_t height;
+        uint64_t offset;    // from the start of the file
+        uint64_t size;      // bytes
+    };
+
+    inline bool IsCompressed(uint32_t format)
+    {
+        return format == FORMAT_BC1 || format == FORMAT_BC3 || format == FORMAT_BC7;
+    }
+
+    inline GLenum InternalFormat(uint32_t format)
+    {
+        switch (format)
+        {
+        case FORMAT_RGB8: return GL_RGB8;
+        case FORMAT_RGBA8: return GL_RGBA8;
+        case FORMAT_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case FORMAT_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case FORMAT_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        }
+        return 0;
+    }
+
+    // Bytes one level of the given size takes
+    inline uint64_t LevelSize(uint32_t format, uint32_t width, uint32_t height)
+    {
+        const uint64_t blocks = (uint64_t)((width + 3) / 4) * ((height + 3) / 4);
+        switch (format)
+        {
+        case FORMAT_RGB8: return (uint64_t)width * height * 3;
+        case FORMAT_RGBA8: return (uint64_t)width * height * 4;
+        case FORMAT_BC1: return blocks * 8;
+        case FORMAT_BC3:
+        case FORMAT_BC7: return blocks * 16;
+        }
+        return 0;
+    }
+
+    inline const char* FormatName(uint32_t format)
+    {
+        switch (format)
+        {
+        case FORMAT_RGB8: return "rgb8";
+        case FORMAT_RGBA8: return "rgba8";
+        case FORMAT_BC1: return "bc1";
+        case FORMAT_BC3: return "bc3";
+        case FORMAT_BC7: return "bc7";
+        }
+        return "unknown";
+    }
+}
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() : mData(NULL), mSize(0)
+#ifdef _WIN32
+        , mFile(INVALID_HANDLE_VALUE), mMapping(NULL)
+#endif
+    {
+    }
+
+    ~MappedFile() { Close(); }
+
+    bool Open(const std::string& filename)
+    {
+        Close();
+#ifdef _WIN32
+        mFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (mFile == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+            return false;
+        mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!mMapping)
+            return false;
+        mData = (const unsigned char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+        mSize = (size_t)size.QuadPart;
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+        void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+            return false;
+        mData = (const unsigned char*)data;
+        mSize = (size_t)info.st_size;
+#endif
+        return mData != NULL;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (mData)
+            UnmapViewOfFile(mData);
+        if (mMapping)
+            CloseHandle(mMapping);
+        if (mFile != INVALID_HANDLE_VALUE)
+            CloseHandle(mFile);
+        mMapping = NULL;
+        mFile = INVALID_HANDLE_VALUE;
+#else
+        if (mData)
+            munmap((void*)mData, mSize);
+#endif
+        mData = NULL;
+        mSize = 0;
+    }
+
+    // Touches every page so the reads happen here instead of on first use
+    void Prefault() const
+    {
+        volatile unsigned char sink = 0;
+        for (size_t i = 0; i < mSize; i += 4096)
+            sink ^= mData[i];
+        (void)sink;
+    }
+
+    const unsigned char* Data() const { return mData; }
+    size_t Size() const { return mSize; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const unsigned char* mData;
+    size_t mSize;
+#ifdef _WIN32
+    HANDLE mFile;
+    HANDLE mMapping;
+#endif
+};
+
+// A mapped .tex file with its header and level table checked
+class CookedTexture
+{
+public:
+    bool Open(const std::string& filename)
+    {
+        if (!mFile.Open(filename))
+        {
+            std::cout << "WARNING: Could not map cooked texture " << filename << std::endl;
+            return false;
+        }
+
+        if (mFile.Size() < sizeof(cooked::Header))
+            return Invalid(filename, "file too small");
+        memcpy(&mHeader, mFile.Data(), sizeof(mHeader));
+        if (memcmp(mHeader.magic, cooked::MAGIC, 4) != 0)
+            return Invalid(filename, "bad magic");
+        if (mHeader.version != cooked::VERSION)
+            return Invalid(filename, "unsupported version");
+        if (cooked::InternalFormat(mHeader.format) == 0)
+            return Invalid(filename, "unknown format");
+        if (mHeader.levels == 0 || mHeader.levels > 16)
+            return Invalid(filename, "bad level count");
+
+        const size_t tableEnd = sizeof(cooked::Header) + mHeader.levels * sizeof(cooked::Level);
+        if (mFile.Size() < tableEnd)
+            return Invalid(filename, "truncated level table");
+
+        mLevels.resize(mHeader.levels);
+        memcpy(mLevels.data(), mFile.Data() + sizeof(cooked::Header), mHeader.levels * sizeof(cooked::Level));
+        for (size_t i = 0; i < mLevels.size(); ++i)
+        {
+            const cooked::Level& level = mLevels[i];
+            if (level.offset < tableEnd || level.offset + level.size > mFile.Size()
+                || level.size != cooked::LevelSize(mHeader.format, level.width, level.height))
+                return Invalid(filename, "bad level entry");
+        }
+        return true;
+    }
+
+    void Prefault() const { mFile.Prefault(); }
+
+    uint32_t Format() const { return mHeader.format; }
+    uint32_t Width() const { return mHeader.width; }
+    uint32_t Height() const { return mHeader.height; }
+    size_t LevelCount() const { return mLevels.size(); }
+    const cooked::Level& Level(size_t i) const { return mLevels[i]; }
+    const unsigned char* LevelData(size_t i) const { return mFile.Data() + mLevels[i].offset; }
+
+private:
+    bool Invalid(const std::string& filename, const char* reason)
+    {
+        std::cout << "WARNING: Cooked texture " << filename << " is invalid: " << reason << std::endl;
+        mFile.Close();
+        mLevels.clear();
+        return false;
+    }
+
+    MappedFile mFile;
+    cooked::Header mHeader;
+    std::vector<cooked::Level> mLevels;
+};
@@ -0,0 +1,157 @@
+// Offline texture cook tool: turns a JPEG / PNG into a .tex container
+// (see texture_container.h) with the rows flipped for GL and the full mip
+// chain built, optionally block compressed.
+//
+//   texture_cook input.jpg output.tex [rgb8 | rgba8 | bc1 | bc3]
+//
+// Default format is bc1 for images without alpha and bc3 for images with.
+// Put output.tex next to input.jpg with the same name and the app loads it
+// instead of decoding the JPEG.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "bc_encoder.h"
+#include "image_ops.h"
+#include "texture_container.h"
+
+using namespace std;
+
+namespace
+{
+    // One mip level as RGBA8, bottom row first
+    struct Image
+    {
+        int width;
+        int height;
+        vector<uint8_t> rgba;
+    };
+
+    // Next mip level, 2x2 box filter
+    Image Downsample(const Image& source)
+    {
+        Image next;
+        next.width = max(1, source.width / 2);
+        next.height = max(1, source.height / 2);
+        next.rgba.resize((size_t)next.width * next.height * 4);
+        image_ops::Downsample(source.rgba.data(), source.width, source.height, next.rgba.data());
+        return next;
+    }
+
+    vector<uint8_t> EncodeLevel(const Image& image, uint32_t format)
+    {
+        switch (format)
+        {
+        case cooked::FORMAT_RGBA8:
+            return image.rgba;
+        case cooked::FORMAT_RGB8:
+        {
+            vector<uint8_t> rgb((size_t)image.width * image.height * 3);
+            for (size_t i = 0; i < (size_t)image.width * image.height; ++i)
+                memcpy(&rgb[i * 3], &image.rgba[i * 4], 3);
+            return rgb;
+        }
+        case cooked::FORMAT_BC1:
+            return bc_encoder::EncodeImage(image.rgba.data(), image.width, image.height, false);
+        case cooked::FORMAT_BC3:
+            return bc_encoder::EncodeImage(image.rgba.data(), image.width, image.height, true);
+        }
+        return vector<uint8_t>();
+    }
+
+    bool ParseFormat(const char* name, uint32_t& format)
+    {
+        const uint32_t formats[] = { cooked::FORMAT_RGB8, cooked::FORMAT_RGBA8, cooked::FORMAT_BC1, cooked::FORMAT_BC3 };
+        for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i)
+        {
+            if (strcmp(name, cooked::FormatName(formats[i])) == 0)
+            {
+                format = formats[i];
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3 || argc > 4)
+    {
+        cout << "usage: texture_cook input.jpg output.tex [rgb8 | rgba8 | bc1 | bc3]" << endl;
+        return EXIT_FAILURE;
+    }
+
+    Image image;
+    int channels = 0;
+    unsigned char* pixels = stbi_load(argv[1], &image.width, &image.height, &channels, 4);
+    if (!pixels)
+    {
+        cout << "Failed to load " << argv[1] << endl;
+        return EXIT_FAILURE;
+    }
+    // GL wants the bottom row first; doing it here means the app never flips
+    image.rgba = image_ops::ToRGBA(pixels, image.width, image.height, 4);
+    stbi_image_free(pixels);
+
+    uint32_t format = channels == 4 ? cooked::FORMAT_BC3 : cooked::FORMAT_BC1;
+    if (argc == 4 && !ParseFormat(argv[3], format))
+    {
+        cout << "Unknown format " << argv[3] << " (bc7 payloads have to come from an external encoder)" << endl;
+        return EXIT_FAILURE;
+    }
+
+    vector<Image> chain(1, image);
+    while (chain.back().width > 1 || chain.back().height > 1)
+        chain.push_back(Downsample(chain.back()));
+
+    cooked::Header header;
+    memcpy(header.magic, cooked::MAGIC, 4);
+    header.version = cooked::VERSION;
+    header.format = format;
+    header.width = (uint32_t)image.width;
+    header.height = (uint32_t)image.height;
+    header.levels = (uint32_t)chain.size();
+
+    vector<cooked::Level> levels(chain.size());
+    vector<vector<uint8_t> > payloads(chain.size());
+    uint64_t offset = sizeof(cooked::Header) + chain.size() * sizeof(cooked::Level);
+    for (size_t i = 0; i < chain.size(); ++i)
+    {
+        offset = (offset + 15) & ~(uint64_t)15;
+        payloads[i] = EncodeLevel(chain[i], format);
+        levels[i].width = (uint32_t)chain[i].width;
+        levels[i].height = (uint32_t)chain[i].height;
+        levels[i].offset = offset;
+        levels[i].size = payloads[i].size();
+        offset += payloads[i].size();
+    }
+
+    FILE* file = fopen(argv[2], "wb");
+    if (!file)
+    {
+        cout << "Failed to open " << argv[2] << " for writing" << endl;
+        return EXIT_FAILURE;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(levels.data(), sizeof(cooked::Level), levels.size(), file);
+    const char padding[16] = { 0 };
+    for (size_t i = 0; i < chain.size(); ++i)
+    {
+        long at = ftell(file);
+        fwrite(padding, 1, (size_t)(levels[i].offset - at), file);
+        fwrite(payloads[i].data(), 1, payloads[i].size(), file);
+    }
+    fclose(file);
+
+    size_t source = (size_t)image.width * image.height * channels;
+    cout << "INFO: " << argv[1] << " -> " << argv[2] << ": " << image.width << "x" << image.height << " "
+        << cooked::FormatName(format) << ", " << chain.size() << " levels, " << offset << " bytes (level 0 uncompressed "
+        << source << " bytes)" << endl;
+    return EXIT_SUCCESS;
+}
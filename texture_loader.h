@@ -0,0 +1,400 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "gpu_resources.h"
+#include "image_ops.h"
+#include "stb_image.h"
+#include "texture_container.h"
+#include "thread_pool.h"
+
+// Where a loaded image lands: a whole GL_TEXTURE_2D of its own (layer < 0)
+// or a rectangle of one layer of a GL_TEXTURE_2D_ARRAY owned by the caller
+// (see material_textures.h)
+struct TextureSlot
+{
+    GLuint texture;
+    GLint layer;
+    GLint x, y;             // texel offset inside the layer
+    GLint width, height;    // size the layer rectangle expects, checked on upload
+    bool cooked;            // take every level of the .tex file instead of decoding
+};
+
+// Loads image files in the background. Request() hands back a texture name
+// at once, holding a 2x2 grey checker placeholder; worker threads decode
+// the files in parallel and Update(), on the GL thread, streams finished
+// images into their textures through a pixel unpack buffer. Texture names
+// never change, so anything holding one starts showing the real image as
+// soon as it is resident.
+//
+// When a cooked .tex file sits next to the requested image (plane.jpg ->
+// plane.tex) it is used instead: the worker only maps it and pages it in,
+// and every stored mip level is uploaded as is, with no decode, flip or
+// mipmap generation.
+//
+// RequestLayer() does the same into a rectangle of a texture array layer;
+// arrays that received decoded images get their mipmaps rebuilt once at
+// the end of each Update().
+class TextureLoader
+{
+public:
+    TextureLoader() : mPboSize(0), mRequested(0), mFinished(0), mFailed(0), mCooked(0), mReported(false) {}
+
+    // workers = 0 uses one decode thread per hardware thread
+    void Init(unsigned workers = 0)
+    {
+        mPool.reset(new ThreadPool(workers));
+        mPbo.Create("texture upload");
+    }
+
+    // Returns the texture for filename, placeholder contents until Update()
+    // uploads the decoded image. Fails only when the file cannot be opened.
+    bool Request(const std::string& filename, GLuint& textureId)
+    {
+        const std::string cookedName = CookedName(filename);
+        const bool cooked = FileExists(cookedName);
+        if (!cooked && !FileExists(filename))
+            return false;
+
+        GpuTexture texture;
+        texture.Create(filename);
+        textureId = texture.Id();
+        glBindTexture(GL_TEXTURE_2D, textureId);
+        SetSampling();
+        const unsigned char checker[] = { 96, 96, 96, 160, 160, 160, 160, 160, 160, 96, 96, 96 };
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 2, 2, 0, GL_RGB, GL_UNSIGNED_BYTE, checker);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        texture.SetSize(sizeof(checker));
+        mTextures.push_back(std::move(texture));
+
+        TextureSlot target = { textureId, -1, 0, 0, 0, 0, cooked };
+        Queue(cooked ? cookedName : filename, target);
+        return true;
+    }
+
+    // Streams filename (or its .tex file when slot.cooked) into a layer
+    // rectangle. The array's storage must already exist. Fails only when
+    // the file cannot be opened.
+    bool RequestLayer(const std::string& filename, const TextureSlot& slot)
+    {
+        const std::string source = slot.cooked ? CookedName(filename) : filename;
+        if (!FileExists(source))
+            return false;
+        Queue(source, slot);
+        return true;
+    }
+
+    // Uploads decoded images, stopping once byteBudget bytes went up this
+    // call (at least one image always goes). Call once per frame.
+    void Update(size_t byteBudget = 32u << 20)
+    {
+        size_t uploaded = 0;
+        while (uploaded < byteBudget)
+        {
+            DecodedImage image;
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                if (mDone.empty())
+                    break;
+                image = std::move(mDone.front());
+                mDone.pop_front();
+            }
+            uploaded += Upload(image);
+        }
+
+        // one rebuild per array however many of its layers changed
+        for (size_t i = 0; i < mStaleMips.size(); ++i)
+        {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, mStaleMips[i]);
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        }
+        if (!mStaleMips.empty())
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        mStaleMips.clear();
+
+        ReportWhenResident();
+    }
+
+    // Blocks until every requested texture is resident (or failed). Decodes
+    // run in parallel, so this takes about as long as the slowest one.
+    void Finish()
+    {
+        while (mFinished < mRequested)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mReady.wait(lock, [this] { return !mDone.empty(); });
+            }
+            Update((size_t)-1);
+        }
+    }
+
+    bool AllResident() const { return mFinished == mRequested; }
+
+    void Release()
+    {
+        // joining the workers first means nothing lands in mDone afterwards
+        mPool.reset();
+        mDone.clear();
+        mStaleMips.clear();
+
+        mTextures.clear();
+        mPbo.Reset();
+        mPboSize = 0;
+    }
+
+    // plane.jpg -> plane.tex, next to the source image
+    static std::string CookedName(const std::string& filename)
+    {
+        size_t dot = filename.find_last_of('.');
+        size_t slash = filename.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            return filename + ".tex";
+        return filename.substr(0, dot) + ".tex";
+    }
+
+    static bool FileExists(const std::string& filename)
+    {
+        FILE* file = fopen(filename.c_str(), "rb");
+        if (!file)
+            return false;
+        fclose(file);
+        return true;
+    }
+
+private:
+    struct DecodedImage
+    {
+        std::string filename;
+        TextureSlot slot;
+        std::vector<unsigned char> pixels;  // RGBA8, bottom row first; empty when decoding failed
+        int width, height;
+        std::shared_ptr<CookedTexture> cooked;  // set instead of pixels for .tex files
+    };
+
+    void Queue(const std::string& filename, const TextureSlot& slot)
+    {
+        if (mRequested == mFinished)
+        {
+            mStart = std::chrono::steady_clock::now();
+            mReported = false;
+        }
+        ++mRequested;
+
+        if (slot.cooked)
+            mPool->Submit([this, filename, slot]() { MapCooked(filename, slot); });
+        else
+            mPool->Submit([this, filename, slot]() { Decode(filename, slot); });
+    }
+
+    // Same sampling the textures always had: repeat, linear
+    static void SetSampling()
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    // Worker thread: no GL here
+    void Decode(const std::string& filename, const TextureSlot& slot)
+    {
+        DecodedImage image;
+        image.filename = filename;
+        image.slot = slot;
+        int channels = 0;
+        unsigned char* decoded = stbi_load(filename.c_str(), &image.width, &image.height, &channels, 0);
+        if (decoded)
+        {
+            // any channel count becomes RGBA8, flipped for GL in the same pass. One thread:
+            // the pool already decodes one image per worker
+            image.pixels = image_ops::ToRGBA(decoded, image.width, image.height, channels, 1);
+            stbi_image_free(decoded);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mDone.push_back(std::move(image));
+        }
+        mReady.notify_one();
+    }
+
+    // Worker thread: map the cooked file and read it in, still no GL
+    void MapCooked(const std::string& filename, const TextureSlot& slot)
+    {
+        DecodedImage image;
+        image.filename = filename;
+        image.slot = slot;
+        image.width = image.height = 0;
+        image.cooked.reset(new CookedTexture());
+        if (image.cooked->Open(filename))
+            image.cooked->Prefault();
+        else
+            image.cooked.reset();
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mDone.push_back(std::move(image));
+        }
+        mReady.notify_one();
+    }
+
+    // GL thread: every level straight from the mapping. Compressed levels
+    // go up as they are; the chain is complete so sampling uses it.
+    size_t UploadCooked(const DecodedImage& image)
+    {
+        const CookedTexture& tex = *image.cooked;
+        const uint32_t format = tex.Format();
+        if ((format == cooked::FORMAT_BC1 || format == cooked::FORMAT_BC3) && !GLEW_EXT_texture_compression_s3tc)
+        {
+            std::cout << "WARNING: No S3TC support for " << image.filename << ", keeping placeholder" << std::endl;
+            ++mFailed;
+            return 0;
+        }
+
+        const TextureSlot& slot = image.slot;
+        const bool layer = slot.layer >= 0;
+        if (layer && ((GLint)tex.Width() != slot.width || (GLint)tex.Height() != slot.height))
+        {
+            std::cout << "WARNING: " << image.filename << " changed size since its layer was laid out, keeping placeholder" << std::endl;
+            ++mFailed;
+            return 0;
+        }
+
+        size_t bytes = 0;
+        const GLenum target = layer ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+        const GLenum pixelFormat = format == cooked::FORMAT_RGBA8 ? GL_RGBA : GL_RGB;
+        glBindTexture(target, slot.texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (size_t i = 0; i < tex.LevelCount(); ++i)
+        {
+            const cooked::Level& level = tex.Level(i);
+            if (layer && cooked::IsCompressed(format))
+                glCompressedTexSubImage3D(target, (GLint)i, slot.x >> i, slot.y >> i, slot.layer, level.width, level.height, 1,
+                    cooked::InternalFormat(format), (GLsizei)level.size, tex.LevelData(i));
+            else if (layer)
+                glTexSubImage3D(target, (GLint)i, slot.x >> i, slot.y >> i, slot.layer, level.width, level.height, 1,
+                    pixelFormat, GL_UNSIGNED_BYTE, tex.LevelData(i));
+            else if (cooked::IsCompressed(format))
+                glCompressedTexImage2D(target, (GLint)i, cooked::InternalFormat(format), level.width, level.height, 0,
+                    (GLsizei)level.size, tex.LevelData(i));
+            else
+                glTexImage2D(target, (GLint)i, cooked::InternalFormat(format), level.width, level.height, 0,
+                    pixelFormat, GL_UNSIGNED_BYTE, tex.LevelData(i));
+            bytes += (size_t)level.size;
+        }
+        // an array's sampling belongs to whoever laid it out
+        if (!layer)
+        {
+            glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint)tex.LevelCount() - 1);
+            glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            GpuResources().Resize(GpuCategory::Texture, slot.texture, bytes);
+        }
+        glBindTexture(target, 0);
+
+        ++mCooked;
+        return bytes;
+    }
+
+    // GL thread: copy into the unpack buffer and let the driver move it to
+    // the texture from there. Returns bytes uploaded.
+    size_t Upload(const DecodedImage& image)
+    {
+        ++mFinished;
+        if (image.cooked)
+            return UploadCooked(image);
+        if (image.pixels.empty())
+        {
+            std::cout << "WARNING: Failed to decode texture " << image.filename << ", keeping placeholder" << std::endl;
+            ++mFailed;
+            return 0;
+        }
+        const TextureSlot& slot = image.slot;
+        const bool layer = slot.layer >= 0;
+        if (layer && (image.width != slot.width || image.height != slot.height))
+        {
+            std::cout << "WARNING: " << image.filename << " changed size since its layer was laid out, keeping placeholder" << std::endl;
+            ++mFailed;
+            return 0;
+        }
+
+        const size_t bytes = image.pixels.size();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mPbo.Id());
+        // orphan: a previous upload may still be reading the old storage
+        mPboSize = std::max(mPboSize, bytes);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, mPboSize, NULL, GL_STREAM_DRAW);
+        mPbo.SetSize(mPboSize);
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped)
+        {
+            memcpy(mapped, image.pixels.data(), bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+
+        // RGBA8 rows are always 4-byte aligned, so the default unpack alignment applies
+        const GLenum target = layer ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+        glBindTexture(target, slot.texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        if (!mapped)
+        {
+            std::cout << "WARNING: Could not map the texture upload buffer for " << image.filename << std::endl;
+            ++mFailed;
+        }
+        else if (layer)
+        {
+            glTexSubImage3D(target, 0, slot.x, slot.y, slot.layer, image.width, image.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+            if (std::find(mStaleMips.begin(), mStaleMips.end(), slot.texture) == mStaleMips.end())
+                mStaleMips.push_back(slot.texture);
+        }
+        else
+        {
+            glTexImage2D(target, 0, GL_RGBA8, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+            glGenerateMipmap(target);
+            // a full mip chain adds a third
+            GpuResources().Resize(GpuCategory::Texture, slot.texture, bytes + bytes / 3);
+        }
+        glBindTexture(target, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return bytes;
+    }
+
+    void ReportWhenResident()
+    {
+        if (mReported || mRequested == 0 || mFinished < mRequested)
+            return;
+        mReported = true;
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - mStart;
+        std::cout << "INFO: " << mRequested - mFailed << " of " << mRequested << " textures resident after "
+            << elapsed.count() << " ms (" << mCooked << " cooked, " << mPool->Size() << " decode threads)" << std::endl;
+    }
+
+    std::unique_ptr<ThreadPool> mPool;
+    std::mutex mMutex;                  // guards mDone
+    std::condition_variable mReady;
+    std::deque<DecodedImage> mDone;     // decoded, waiting for upload
+
+    std::vector<GpuTexture> mTextures; // Request()ed ones; layer arrays belong to their caller
+    std::vector<GLuint> mStaleMips;    // arrays whose level 0 changed this Update()
+    GpuBuffer mPbo;
+    size_t mPboSize;
+    int mRequested;
+    int mFinished;                      // uploaded or failed
+    int mFailed;
+    int mCooked;                        // loaded from .tex files
+    bool mReported;
+    std::chrono::steady_clock::time_point mStart;
+};
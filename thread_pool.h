@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads pulling jobs from one queue. Jobs must not
+// touch GL; only the thread that owns the context may do that.
+class ThreadPool
+{
+public:
+    // 0 = one worker per hardware thread
+    explicit ThreadPool(unsigned workers = 0) : mStopping(false)
+    {
+        if (workers == 0)
+            workers = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < workers; ++i)
+            mWorkers.push_back(std::thread(&ThreadPool::Run, this));
+    }
+
+    // Finishes the jobs already queued, then joins every worker
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mWake.notify_all();
+        for (size_t i = 0; i < mWorkers.size(); ++i)
+            mWorkers[i].join();
+    }
+
+    void Submit(const std::function<void()>& job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mJobs.push_back(job);
+        }
+        mWake.notify_one();
+    }
+
+    size_t Size() const { return mWorkers.size(); }
+
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void Run()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mWake.wait(lock, [this] { return mStopping || !mJobs.empty(); });
+                if (mJobs.empty())
+                    return;
+                job = mJobs.front();
+                mJobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> mWorkers;
+    std::deque<std::function<void()> > mJobs;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    bool mStopping;
+};